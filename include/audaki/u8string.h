@@ -2,7 +2,15 @@
 
 #include <cstddef>
 #include <cassert>
-
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
 
 #include <algorithm>
@@ -20,7 +28,8 @@ enum class Utf8_byte_type: uint8_t {
     single_byte_ascii = 1,
     first_of_two_bytes = 2,
     first_of_three_bytes = 3,
-    first_of_four_bytes = 4
+    first_of_four_bytes = 4,
+    invalid_byte = 5
 };
 
 
@@ -43,7 +52,10 @@ inline Utf8_byte_type get_utf8_byte_type(std::byte byte)
     if ((byte >> 4) == std::byte{0b1110})
         return Type::first_of_three_bytes;
 
-    return Type::first_of_four_bytes;
+    if ((byte >> 3) == std::byte{0b11110})
+        return Type::first_of_four_bytes;
+
+    return Type::invalid_byte;
 }
 
 
@@ -74,6 +86,60 @@ inline bool is_utf8_code_point_begin(char c) noexcept
 }
 
 
+/**
+ * Case mapping tables.
+ *
+ * Case mapping covers ASCII, U+00C0 to U+00FE and ß/ẞ. Everything but ẞ is in the first 256 code points, so
+ * mapping is a table lookup with a single exception. The same mapping as UTF-8 bytes: U+00C0 to U+00FF are
+ * the two byte sequences C3 80 to C3 BF and stay in that range, only their second byte changes.
+ */
+namespace u8_case {
+
+constexpr std::array<uint8_t, 256> make_lower_latin1() noexcept
+{
+    std::array<uint8_t, 256> table{};
+    for (std::size_t c{0}; c != table.size(); ++c) {
+        bool is_upper = (c >= 'A' && c <= 'Z') || (c >= 0xC0 && c <= 0xDE);
+        table[c] = static_cast<uint8_t>(is_upper ? c + 0x20 : c);
+    }
+
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> make_upper_latin1() noexcept
+{
+    std::array<uint8_t, 256> table{};
+    for (std::size_t c{0}; c != table.size(); ++c) {
+        bool is_lower = (c >= 'a' && c <= 'z') || (c >= 0xE0 && c <= 0xFE);
+        table[c] = static_cast<uint8_t>(is_lower ? c - 0x20 : c);
+    }
+
+    return table;
+}
+
+/**
+ * Second bytes of C3 80 to C3 BF, indexed by the low six bits of the second byte.
+ */
+constexpr std::array<uint8_t, 64> make_c3_table(const std::array<uint8_t, 256>& latin1) noexcept
+{
+    std::array<uint8_t, 64> table{};
+    for (std::size_t i{0}; i != table.size(); ++i)
+        table[i] = static_cast<uint8_t>(0x80 | (latin1[0xC0 + i] & 0x3F));
+
+    return table;
+}
+
+/**
+ * ß is missing from upper_latin1 and upper_c3, its upper case ẞ is U+1E9E.
+ */
+inline constexpr std::array<uint8_t, 256> lower_latin1 = make_lower_latin1();
+inline constexpr std::array<uint8_t, 256> upper_latin1 = make_upper_latin1();
+inline constexpr std::array<uint8_t, 64> lower_c3 = make_c3_table(lower_latin1);
+inline constexpr std::array<uint8_t, 64> upper_c3 = make_c3_table(upper_latin1);
+
+}
+
+
 struct Unicode_code_point {
 
     constexpr Unicode_code_point(uint32_t v): v_{v}
@@ -195,206 +261,23 @@ struct Unicode_code_point {
 
     bool icompare(const Unicode_code_point& other) const noexcept
     {
-        switch(v_) {
-            case U'a': case U'A': return other.v_ == U'a' || other.v_ == U'A';
-            case U'b': case U'B': return other.v_ == U'b' || other.v_ == U'B';
-            case U'c': case U'C': return other.v_ == U'c' || other.v_ == U'C';
-            case U'd': case U'D': return other.v_ == U'd' || other.v_ == U'D';
-            case U'e': case U'E': return other.v_ == U'e' || other.v_ == U'E';
-            case U'f': case U'F': return other.v_ == U'f' || other.v_ == U'F';
-            case U'g': case U'G': return other.v_ == U'g' || other.v_ == U'G';
-            case U'h': case U'H': return other.v_ == U'h' || other.v_ == U'H';
-            case U'i': case U'I': return other.v_ == U'i' || other.v_ == U'I';
-            case U'j': case U'J': return other.v_ == U'j' || other.v_ == U'J';
-            case U'k': case U'K': return other.v_ == U'k' || other.v_ == U'K';
-            case U'l': case U'L': return other.v_ == U'l' || other.v_ == U'L';
-            case U'm': case U'M': return other.v_ == U'm' || other.v_ == U'M';
-            case U'n': case U'N': return other.v_ == U'n' || other.v_ == U'N';
-            case U'o': case U'O': return other.v_ == U'o' || other.v_ == U'O';
-            case U'p': case U'P': return other.v_ == U'p' || other.v_ == U'P';
-            case U'q': case U'Q': return other.v_ == U'q' || other.v_ == U'Q';
-            case U'r': case U'R': return other.v_ == U'r' || other.v_ == U'R';
-            case U's': case U'S': return other.v_ == U's' || other.v_ == U'S';
-            case U't': case U'T': return other.v_ == U't' || other.v_ == U'T';
-            case U'u': case U'U': return other.v_ == U'u' || other.v_ == U'U';
-            case U'v': case U'V': return other.v_ == U'v' || other.v_ == U'V';
-            case U'w': case U'W': return other.v_ == U'w' || other.v_ == U'W';
-            case U'x': case U'X': return other.v_ == U'x' || other.v_ == U'X';
-            case U'y': case U'Y': return other.v_ == U'y' || other.v_ == U'Y';
-            case U'z': case U'Z': return other.v_ == U'z' || other.v_ == U'Z';
-
-            case U'à': case U'À': return other.v_ == U'à' || other.v_ == U'À';
-            case U'á': case U'Á': return other.v_ == U'á' || other.v_ == U'Á';
-            case U'â': case U'Â': return other.v_ == U'â' || other.v_ == U'Â';
-            case U'ã': case U'Ã': return other.v_ == U'ã' || other.v_ == U'Ã';
-            case U'ä': case U'Ä': return other.v_ == U'ä' || other.v_ == U'Ä';
-            case U'å': case U'Å': return other.v_ == U'å' || other.v_ == U'Å';
-            case U'æ': case U'Æ': return other.v_ == U'æ' || other.v_ == U'Æ';
-            case U'ç': case U'Ç': return other.v_ == U'ç' || other.v_ == U'Ç';
-            case U'è': case U'È': return other.v_ == U'è' || other.v_ == U'È';
-            case U'é': case U'É': return other.v_ == U'é' || other.v_ == U'É';
-            case U'ê': case U'Ê': return other.v_ == U'ê' || other.v_ == U'Ê';
-            case U'ë': case U'Ë': return other.v_ == U'ë' || other.v_ == U'Ë';
-            case U'ì': case U'Ì': return other.v_ == U'ì' || other.v_ == U'Ì';
-            case U'í': case U'Í': return other.v_ == U'í' || other.v_ == U'Í';
-            case U'î': case U'Î': return other.v_ == U'î' || other.v_ == U'Î';
-            case U'ï': case U'Ï': return other.v_ == U'ï' || other.v_ == U'Ï';
-            case U'ð': case U'Ð': return other.v_ == U'ð' || other.v_ == U'Ð';
-            case U'ñ': case U'Ñ': return other.v_ == U'ñ' || other.v_ == U'Ñ';
-            case U'ò': case U'Ò': return other.v_ == U'ò' || other.v_ == U'Ò';
-            case U'ó': case U'Ó': return other.v_ == U'ó' || other.v_ == U'Ó';
-            case U'ô': case U'Ô': return other.v_ == U'ô' || other.v_ == U'Ô';
-            case U'õ': case U'Õ': return other.v_ == U'õ' || other.v_ == U'Õ';
-            case U'ö': case U'Ö': return other.v_ == U'ö' || other.v_ == U'Ö';
-            case U'÷': case U'×': return other.v_ == U'÷' || other.v_ == U'×';
-            case U'ø': case U'Ø': return other.v_ == U'ø' || other.v_ == U'Ø';
-            case U'ù': case U'Ù': return other.v_ == U'ù' || other.v_ == U'Ù';
-            case U'ú': case U'Ú': return other.v_ == U'ú' || other.v_ == U'Ú';
-            case U'û': case U'Û': return other.v_ == U'û' || other.v_ == U'Û';
-            case U'ü': case U'Ü': return other.v_ == U'ü' || other.v_ == U'Ü';
-            case U'ý': case U'Ý': return other.v_ == U'ý' || other.v_ == U'Ý';
-            case U'þ': case U'Þ': return other.v_ == U'þ' || other.v_ == U'Þ';
-            case U'ß': case U'ẞ': return other.v_ == U'ß' || other.v_ == U'ẞ';
-
-            default:
-                return v_ == other.v_;
-        }
+        return as_lower_case() == other.as_lower_case();
     }
 
     Unicode_code_point as_upper_case() const noexcept
     {
-        switch(v_) {
-            case U'a': return U'A';
-            case U'b': return U'B';
-            case U'c': return U'C';
-            case U'd': return U'D';
-            case U'e': return U'E';
-            case U'f': return U'F';
-            case U'g': return U'G';
-            case U'h': return U'H';
-            case U'i': return U'I';
-            case U'j': return U'J';
-            case U'k': return U'K';
-            case U'l': return U'L';
-            case U'm': return U'M';
-            case U'n': return U'N';
-            case U'o': return U'O';
-            case U'p': return U'P';
-            case U'q': return U'Q';
-            case U'r': return U'R';
-            case U's': return U'S';
-            case U't': return U'T';
-            case U'u': return U'U';
-            case U'v': return U'V';
-            case U'w': return U'W';
-            case U'x': return U'X';
-            case U'y': return U'Y';
-            case U'z': return U'Z';
-
-            case U'à': return U'À';
-            case U'á': return U'Á';
-            case U'â': return U'Â';
-            case U'ã': return U'Ã';
-            case U'ä': return U'Ä';
-            case U'å': return U'Å';
-            case U'æ': return U'Æ';
-            case U'ç': return U'Ç';
-            case U'è': return U'È';
-            case U'é': return U'É';
-            case U'ê': return U'Ê';
-            case U'ë': return U'Ë';
-            case U'ì': return U'Ì';
-            case U'í': return U'Í';
-            case U'î': return U'Î';
-            case U'ï': return U'Ï';
-            case U'ð': return U'Ð';
-            case U'ñ': return U'Ñ';
-            case U'ò': return U'Ò';
-            case U'ó': return U'Ó';
-            case U'ô': return U'Ô';
-            case U'õ': return U'Õ';
-            case U'ö': return U'Ö';
-            case U'÷': return U'×';
-            case U'ø': return U'Ø';
-            case U'ù': return U'Ù';
-            case U'ú': return U'Ú';
-            case U'û': return U'Û';
-            case U'ü': return U'Ü';
-            case U'ý': return U'Ý';
-            case U'þ': return U'Þ';
-            case U'ß': return U'ẞ';
-
-            default:
-                return v_;
-        }
+        if (v_ <= 0xFF)
+            return v_ == 0xDF ? Unicode_code_point{U'ẞ'} : Unicode_code_point{static_cast<uint32_t>(u8_case::upper_latin1[v_])};
+
+        return v_;
     }
 
     Unicode_code_point as_lower_case() const noexcept
     {
-        switch(v_) {
-            case U'A': return U'a';
-            case U'B': return U'b';
-            case U'C': return U'c';
-            case U'D': return U'd';
-            case U'E': return U'e';
-            case U'F': return U'f';
-            case U'G': return U'g';
-            case U'H': return U'h';
-            case U'I': return U'i';
-            case U'J': return U'j';
-            case U'K': return U'k';
-            case U'L': return U'l';
-            case U'M': return U'm';
-            case U'N': return U'n';
-            case U'O': return U'o';
-            case U'P': return U'p';
-            case U'Q': return U'q';
-            case U'R': return U'r';
-            case U'S': return U's';
-            case U'T': return U't';
-            case U'U': return U'u';
-            case U'V': return U'v';
-            case U'W': return U'w';
-            case U'X': return U'x';
-            case U'Y': return U'y';
-            case U'Z': return U'z';
-
-            case U'À': return U'à';
-            case U'Á': return U'á';
-            case U'Â': return U'â';
-            case U'Ã': return U'ã';
-            case U'Ä': return U'ä';
-            case U'Å': return U'å';
-            case U'Æ': return U'æ';
-            case U'Ç': return U'ç';
-            case U'È': return U'è';
-            case U'É': return U'é';
-            case U'Ê': return U'ê';
-            case U'Ë': return U'ë';
-            case U'Ì': return U'ì';
-            case U'Í': return U'í';
-            case U'Î': return U'î';
-            case U'Ï': return U'ï';
-            case U'Ð': return U'ð';
-            case U'Ñ': return U'ñ';
-            case U'Ò': return U'ò';
-            case U'Ó': return U'ó';
-            case U'Ô': return U'ô';
-            case U'Õ': return U'õ';
-            case U'Ö': return U'ö';
-            case U'×': return U'÷';
-            case U'Ø': return U'ø';
-            case U'Ù': return U'ù';
-            case U'Ú': return U'ú';
-            case U'Û': return U'û';
-            case U'Ü': return U'ü';
-            case U'Ý': return U'ý';
-            case U'Þ': return U'þ';
-            case U'ẞ': return U'ß';
-
-            default:
-                return v_;
-        }
+        if (v_ <= 0xFF)
+            return Unicode_code_point{static_cast<uint32_t>(u8_case::lower_latin1[v_])};
+
+        return v_ == U'ẞ' ? U'ß' : v_;
     }
 
 
@@ -404,6 +287,94 @@ struct Unicode_code_point {
 
 
 
+struct Utf8_decoded {
+    Unicode_code_point code_point;
+    std::size_t byte_count;
+};
+
+
+/**
+ * Decode the code point starting at p with n > 0 bytes available.
+ *
+ * Ill-formed sequences (stray continuation bytes, truncated sequences, overlongs, surrogates,
+ * code points above U+10FFFF) decode to U+FFFD. The replacement covers the maximal subpart of the
+ * sequence, so the decoder resynchronizes on the next byte which can't belong to it.
+ */
+inline Utf8_decoded decode_utf8(const char* p, std::size_t n) noexcept
+{
+    uint8_t lead = static_cast<uint8_t>(p[0]);
+    if (lead < 0x80)
+        return {Unicode_code_point{static_cast<uint32_t>(lead)}, 1};
+
+    std::size_t length;
+    uint32_t v;
+    uint8_t min = 0x80;
+    uint8_t max = 0xBF;
+
+    if (lead < 0xC2) {
+        return {Unicode_code_point{0xFFFDu}, 1};
+    }
+    else if (lead < 0xE0) {
+        length = 2;
+        v = lead & 0b0001'1111u;
+    }
+    else if (lead < 0xF0) {
+        length = 3;
+        v = lead & 0b0000'1111u;
+        if (lead == 0xE0)
+            min = 0xA0;
+        if (lead == 0xED)
+            max = 0x9F;
+    }
+    else if (lead < 0xF5) {
+        length = 4;
+        v = lead & 0b0000'0111u;
+        if (lead == 0xF0)
+            min = 0x90;
+        if (lead == 0xF4)
+            max = 0x8F;
+    }
+    else {
+        return {Unicode_code_point{0xFFFDu}, 1};
+    }
+
+    for (std::size_t i{1}; i != length; ++i) {
+        if (i == n)
+            return {Unicode_code_point{0xFFFDu}, i};
+
+        uint8_t byte = static_cast<uint8_t>(p[i]);
+        if (byte < min || byte > max)
+            return {Unicode_code_point{0xFFFDu}, i};
+
+        min = 0x80;
+        max = 0xBF;
+        v = (v << 6) | (byte & 0b0011'1111u);
+    }
+
+    return {Unicode_code_point{v}, length};
+}
+
+
+/**
+ * Decode the code point starting at p without any checks. Only for input that passed validate_utf8.
+ */
+inline Utf8_decoded decode_valid_utf8(const char* p) noexcept
+{
+    uint8_t lead = static_cast<uint8_t>(p[0]);
+    if (lead < 0x80)
+        return {Unicode_code_point{static_cast<uint32_t>(lead)}, 1};
+
+    if (lead < 0xE0)
+        return {Unicode_code_point{p[0], p[1]}, 2};
+
+    if (lead < 0xF0)
+        return {Unicode_code_point{p[0], p[1], p[2]}, 3};
+
+    return {Unicode_code_point{p[0], p[1], p[2], p[3]}, 4};
+}
+
+
+
 
 
 
@@ -426,8 +397,9 @@ struct Utf8_view {
 
         using Type = Utf8_byte_type;
 
-        Iterator(Utf8_view* v, std::size_t pos): v_{v}, pos_{pos}, code_point_{to_code_point()}
+        Iterator(Utf8_view* v, std::size_t pos): v_{v}, pos_{pos}
         {
+            decode();
         }
 
 
@@ -477,26 +449,8 @@ struct Utf8_view {
 
         Iterator& operator++() noexcept
         {
-            switch (type()) {
-                case Type::continuation_byte:
-                case Type::single_byte_ascii:
-                    pos_ = std::min(pos_ + 1, v_->byte_count());
-                    break;
-
-                case Type::first_of_two_bytes:
-                    pos_ = std::min(pos_ + 2, v_->byte_count());
-                    break;
-
-                case Type::first_of_three_bytes:
-                    pos_ = std::min(pos_ + 3, v_->byte_count());
-                    break;
-
-                case Type::first_of_four_bytes:
-                    pos_ = std::min(pos_ + 4, v_->byte_count());
-                    break;
-            }
-
-            code_point_ = to_code_point();
+            pos_ += byte_count_;
+            decode();
 
             return *this;
         }
@@ -508,41 +462,65 @@ struct Utf8_view {
         }
 
 
-    private:
-
-        Unicode_code_point to_code_point() noexcept
+        /**
+         * Step back to the previous code point, as forward iteration would have decoded it.
+         *
+         * Back up at most four bytes to a byte which isn't a continuation byte, then decode forward up to the
+         * current position. Continuation bytes outside of sequences decode one by one, so this ends exactly there.
+         */
+        Iterator& operator--() noexcept
         {
-            switch (type()) {
-
-                case Type::continuation_byte:
-                    return {0xFFFDu};
-
-                case Type::single_byte_ascii:
-                    return Unicode_code_point{v_->v_[pos_]};
-
-                case Type::first_of_two_bytes:
-                    if (pos_ + 1 >= v_->byte_count())
-                        return {0xFFFDu};
+            auto is_continuation = [this](std::size_t p) {
+                return (static_cast<uint8_t>(v_->v_[p]) & 0xC0) == 0x80;
+            };
+
+            std::size_t end = pos_;
+            std::size_t p = pos_ - 1;
+            while (p != 0 && is_continuation(p) && end - p != 4)
+                --p;
+
+            while (true) {
+                auto decoded = decode_utf8(v_->v_.data() + p, end - p);
+                if (p + decoded.byte_count == end) {
+                    pos_ = p;
+                    code_point_ = decoded.code_point;
+                    byte_count_ = decoded.byte_count;
+                    return *this;
+                }
+
+                p += decoded.byte_count;
+            }
+        }
 
-                    return Unicode_code_point{v_->v_[pos_], v_->v_[pos_ + 1]};
 
-                case Type::first_of_three_bytes:
-                    if (pos_ + 2 >= v_->byte_count())
-                        return {0xFFFDu};
+        /**
+         * Byte offset of the current code point.
+         */
+        std::size_t position() const noexcept
+        {
+            return pos_;
+        }
 
-                    return Unicode_code_point{v_->v_[pos_], v_->v_[pos_ + 1], v_->v_[pos_ + 2]};
 
-                case Type::first_of_four_bytes:
-                    if (pos_ + 3 >= v_->byte_count())
-                        return {0xFFFDu};
+    private:
 
-                    return Unicode_code_point{v_->v_[pos_], v_->v_[pos_ + 1], v_->v_[pos_ + 2], v_->v_[pos_ + 3]};
+        void decode() noexcept
+        {
+            if (pos_ == v_->byte_count()) {
+                code_point_ = Unicode_code_point{0u};
+                byte_count_ = 0;
+                return;
             }
+
+            auto decoded = decode_utf8(v_->v_.data() + pos_, v_->byte_count() - pos_);
+            code_point_ = decoded.code_point;
+            byte_count_ = decoded.byte_count;
         }
 
         Utf8_view* v_;
         std::size_t pos_;
-        Unicode_code_point code_point_;
+        Unicode_code_point code_point_{0u};
+        std::size_t byte_count_{0};
     };
 
 
@@ -563,93 +541,286 @@ struct Utf8_view {
     }
 
 
-    bool icompare(Utf8_view other)
+    /**
+     * Compare case insensitive, ASCII runs are compared in bulk.
+     */
+    bool icompare(Utf8_view other) noexcept;
+
+    /**
+     * Order case insensitive by lower cased code points, ASCII runs are compared in bulk.
+     */
+    bool iless(Utf8_view other) noexcept;
+
+
+
+    std::string_view v_;
+};
+
+
+struct Utf8_validation {
+
+    /**
+     * Byte offset of the first ill-formed sequence, std::string_view::npos if the input is valid.
+     */
+    std::size_t error_offset;
+
+    explicit operator bool() const noexcept
     {
-        auto it = begin();
-        auto other_it = other.begin();
+        return error_offset == std::string_view::npos;
+    }
+};
 
-        while (it != end() && other_it != other.end()) {
-            if (!it->icompare(*other_it))
-                return false;
 
-            ++it;
-            ++other_it;
-        }
+/**
+ * Validate UTF-8 according to the Unicode standard (no overlongs, surrogates or code points above U+10FFFF).
+ */
+Utf8_validation validate_utf8(std::string_view v) noexcept;
+
+
+/**
+ * A view which is guaranteed to hold valid UTF-8, it can only be created by make_validated_utf8_view.
+ *
+ * Functions taking this type decode without bounds checks or replacement-character handling.
+ */
+class Validated_utf8_view {
+public:
 
-        return (it == end() && other_it == other.end());
+    std::string_view string_view() const noexcept
+    {
+        return v_;
     }
 
+    operator Utf8_view() const noexcept
+    {
+        return Utf8_view{v_};
+    }
 
-    bool iless(Utf8_view other)
+    std::size_t byte_count() const noexcept
     {
-        auto it = begin();
-        auto other_it = other.begin();
+        return v_.size();
+    }
 
-        while (it != end() && other_it != other.end()) {
-            auto lc1 = it->as_lower_case();
-            auto lc2 = other_it->as_lower_case();
+private:
 
-            if (lc1.v_ < lc2.v_)
-                return true;
+    struct Validated {};
 
-            if (lc1.v_ > lc2.v_)
-                return false;
+    Validated_utf8_view(std::string_view v, Validated) noexcept: v_{v}
+    {
+    }
+
+    friend std::optional<Validated_utf8_view> make_validated_utf8_view(std::string_view v) noexcept;
+
+    std::string_view v_;
+};
+
+
+/**
+ * Validate v once, the result can be used for any number of unchecked operations.
+ */
+std::optional<Validated_utf8_view> make_validated_utf8_view(std::string_view v) noexcept;
 
-            ++it;
-            ++other_it;
-        }
 
-        return (it == end() && other_it != other.end());
+/**
+ * Code point offsets of a view, for random access by code point index.
+ *
+ * The index keeps the byte offset of every checkpoint_interval-th code point, so finding any code point decodes
+ * at most checkpoint_interval - 1 code points. A Utf8_view is validated first and then counted in a second,
+ * vectorized pass (decoded one by one if ill-formed), a Validated_utf8_view takes only the counting pass.
+ * Code points are counted like Utf8_view::Iterator steps, every ill-formed sequence is one U+FFFD. The view must
+ * outlive the index.
+ */
+class Utf8_index {
+public:
+
+    static constexpr std::size_t checkpoint_interval = 64;
+
+    explicit Utf8_index(Utf8_view v);
+
+    explicit Utf8_index(Validated_utf8_view v);
+
+    /**
+     * Number of code points.
+     */
+    std::size_t length() const noexcept
+    {
+        return length_;
+    }
+
+    /**
+     * Byte offset of code point n, the byte count of the view for n == length().
+     */
+    std::size_t byte_offset(std::size_t n) const noexcept;
+
+    /**
+     * Index of the code point which contains the byte at offset, length() for the byte count of the view.
+     */
+    std::size_t code_point_index(std::size_t offset) const noexcept;
+
+    /**
+     * Code point n, which must be less than length().
+     */
+    Unicode_code_point at(std::size_t n) const noexcept;
+
+    /**
+     * The count code points from code point begin on, clamped to the end of the view.
+     */
+    std::string_view substr_cp(std::size_t begin, std::size_t count = std::string_view::npos) const noexcept;
+
+    /**
+     * Iterator at code point n, it can be moved in both directions.
+     */
+    Utf8_view::Iterator iterator_at(std::size_t n) noexcept
+    {
+        return {&view_, byte_offset(std::min(n, length_))};
+    }
+
+    Utf8_view view() const noexcept
+    {
+        return view_;
     }
 
+private:
 
+    std::size_t advance(std::size_t offset, std::size_t n) const noexcept;
 
-    std::string_view v_;
+    Utf8_view view_;
+    bool is_valid_;
+    std::size_t length_{0};
+    std::vector<std::size_t> checkpoints_;
 };
 
 
-inline std::string as_lower_cased_string(Utf8_view v)
+/**
+ * Lower case all code points. ASCII runs are converted in bulk.
+ */
+std::string as_lower_cased_string(Utf8_view v);
+
+/**
+ * Upper case all code points. ASCII runs are converted in bulk.
+ */
+std::string as_upper_cased_string(Utf8_view v);
+
+std::string as_lower_cased_string(Validated_utf8_view v);
+
+std::string as_upper_cased_string(Validated_utf8_view v);
+
+/**
+ * Exact size of as_lower_cased_string(v), without building it. Only ẞ and ill-formed sequences, which become
+ * U+FFFD, change the encoded length.
+ */
+std::size_t lower_cased_size(Utf8_view v) noexcept;
+
+std::size_t upper_cased_size(Utf8_view v) noexcept;
+
+/**
+ * Write the lower cased v to out, which needs room for lower_cased_size(v) bytes. Returns the number of bytes written.
+ */
+std::size_t to_lower_into(Utf8_view v, char* out) noexcept;
+
+std::size_t to_upper_into(Utf8_view v, char* out) noexcept;
+
+/**
+ * Append the lower cased v to out, which grows at most once.
+ */
+void to_lower_into(Utf8_view v, std::string& out);
+
+void to_upper_into(Utf8_view v, std::string& out);
+
+void to_lower_into(Validated_utf8_view v, std::string& out);
+
+void to_upper_into(Validated_utf8_view v, std::string& out);
+
+/**
+ * Lower case s without a second buffer, unless ill-formed sequences have to be replaced by the longer U+FFFD.
+ */
+void to_lower_in_place(std::string& s);
+
+/**
+ * Upper case s without a second buffer, unless ß (ẞ is one byte longer) or ill-formed sequences need more room.
+ */
+void to_upper_in_place(std::string& s);
+
+
+namespace u8_case {
+
+/**
+ * Size of the longest prefix of v which has at most max_size bytes and ends on a code point boundary.
+ *
+ * Every byte which isn't a continuation byte starts a code point, and a run of four continuation bytes can't
+ * belong to a single sequence, so the boundary is at most three bytes back.
+ */
+inline std::size_t code_point_prefix_size(std::string_view v, std::size_t max_size) noexcept
 {
-    std::string string;
-    for (auto& c: v) {
-        string += c.as_lower_case().to_utf8().data();
+    if (v.size() <= max_size)
+        return v.size();
+
+    for (std::size_t back{0}; back != 4 && back != max_size; ++back) {
+        if ((static_cast<uint8_t>(v[max_size - back]) & 0xC0) != 0x80)
+            return max_size - back;
     }
-    return string;
+
+    return max_size;
 }
 
 
-inline std::string as_upper_cased_string(Utf8_view v)
+template<class Output_iterator, class Case_map>
+Output_iterator case_map_copy(Utf8_view v, Output_iterator out, Case_map case_map)
 {
-    std::string string;
-    for (auto& c: v) {
-        string += c.as_upper_case().to_utf8().data();
+    // Map in chunks on the stack, U+FFFD makes a chunk grow by three times at most
+    constexpr std::size_t chunk_size = 256;
+    std::array<char, 3 * chunk_size> buffer;
+
+    std::string_view rest = v.v_;
+    while (!rest.empty()) {
+        std::size_t chunk = code_point_prefix_size(rest, chunk_size);
+        std::size_t size = case_map(Utf8_view{rest.substr(0, chunk)}, buffer.data());
+        out = std::copy_n(buffer.data(), size, out);
+        rest.remove_prefix(chunk);
     }
-    return string;
+
+    return out;
+}
+
 }
 
 
 /**
- * This will truncate the string if either max_length or max_lines is reached.
+ * Write the lower cased v to the output iterator out, without allocating. Returns the iterator past the last byte.
  */
-inline std::string truncate_by_length_and_lines(std::string s, std::size_t max_length, std::size_t max_lines, std::string truncate_marker = " ...")
+template<class Output_iterator>
+Output_iterator to_lower_copy(Utf8_view v, Output_iterator out)
 {
-    std::size_t glyph_count{0};
-    std::size_t line_count{1};
-    for (std::size_t i{0}; i != s.size(); ++i)
-    {
-        char c = s[i];
-        if (is_utf8_code_point_begin(c))
-            ++glyph_count;
+    return u8_case::case_map_copy(v, out, [](Utf8_view chunk, char* buffer) {
+        return to_lower_into(chunk, buffer);
+    });
+}
 
-        if (c == '\n')
-            ++line_count;
+template<class Output_iterator>
+Output_iterator to_upper_copy(Utf8_view v, Output_iterator out)
+{
+    return u8_case::case_map_copy(v, out, [](Utf8_view chunk, char* buffer) {
+        return to_upper_into(chunk, buffer);
+    });
+}
 
-        bool limit_reached = glyph_count > max_length || line_count > max_lines;
-        if (limit_reached) {
-            s.resize(i);
-            s += truncate_marker;
-            break;
-        }
+
+/**
+ * Byte offset at which to truncate v so it has at most max_length code points and max_lines lines, or npos if v
+ * is within both limits. Code points are counted with is_utf8_code_point_begin.
+ */
+std::size_t find_truncation_point(std::string_view v, std::size_t max_length, std::size_t max_lines) noexcept;
+
+/**
+ * This will truncate the string if either max_length or max_lines is reached.
+ *
+ * Strings within the limits are returned as they are, so moving them in never allocates.
+ */
+inline std::string truncate_by_length_and_lines(std::string s, std::size_t max_length, std::size_t max_lines, std::string truncate_marker = " ...")
+{
+    std::size_t point = find_truncation_point(s, max_length, max_lines);
+    if (point != std::string_view::npos) {
+        s.resize(point);
+        s += truncate_marker;
     }
 
     return s;
@@ -669,139 +840,500 @@ inline constexpr bool is_utf8(char c) {
     return (c & 0b1000'0000);
 }
 
+/**
+ * The string without leading and trailing trim_c, a view into string.
+ */
 template <char trim_c>
-inline std::string trim(const std::string& string)
+inline std::string_view trim_view(Utf8_view string) noexcept
 {
-    size_t first = string.find_first_not_of(trim_c);
-    if (first == std::string::npos) {
+    size_t first = string.v_.find_first_not_of(trim_c);
+    if (first == std::string_view::npos) {
         return {};
     }
-    size_t last = string.find_last_not_of(trim_c);
-    return string.substr(first, 1 + last - first);
+    size_t last = string.v_.find_last_not_of(trim_c);
+    return string.v_.substr(first, 1 + last - first);
 }
 
-/**
- * Split by template-supplied delimiter char.
- */
-template<unsigned char delimiter>
-inline std::vector<std::string> split(const std::string& string)
+template <char trim_c>
+inline std::string trim(const std::string& string)
 {
-    return std::accumulate(string.begin(), string.end(), std::vector<std::string>{""}, [](auto& v, char c) {
-        switch (c) {
-            case delimiter: v.push_back(""); break;
-            default: v.back().push_back(c); break;
-        }
-        return v;
-    });
+    return std::string{trim_view<trim_c>(string)};
 }
 
 /**
- * Split by delimiter chars.
+ * A set of bytes, e.g. delimiters or whitespace, searched for 16 or 32 bytes at a time.
+ *
+ * Besides the 256 bit bitmap, the class is stored as two nibble tables in the way of the "shufti" matcher of
+ * Hyperscan: the high nibbles with the same set of low nibbles share one of 8 buckets, a byte is in the class if
+ * the bucket bits of its high and its low nibble overlap. Two byte shuffles classify a whole vector. Classes with
+ * more than 8 distinct low nibble sets, and targets without byte shuffles, use the bitmap instead, or compare
+ * against each byte of small classes.
  */
-template<std::size_t N>
-inline std::vector<std::string> split(const std::string& string, std::array<char, N> delimiters)
-{
-    return std::accumulate(string.begin(), string.end(), std::vector<std::string>{""}, [&](auto& v, char c) {
-        for (char d: delimiters) {
-            if (c == d) {
-                v.push_back("");
-                return v;
-            }
-        }
-        v.back().push_back(c);
-        return v;
-    });
-}
+class Byte_class {
+public:
 
-/**
-    * Split once by template-supplied delimiter char.
-    */
-template<unsigned char delimiter>
-inline std::pair<std::string, std::string> split_once(const std::string& string)
-{
-    std::pair<std::string, std::string> parts;
-    size_t size{string.size()}, i{0};
-    while (i < size && string[i] != delimiter) {
-        parts.first += string[i];
-        ++i;
+    static constexpr std::size_t max_compared_bytes = 8;
+
+    constexpr Byte_class() noexcept = default;
+
+    constexpr explicit Byte_class(std::string_view bytes) noexcept
+    {
+        std::array<uint16_t, 16> low_sets{};
+        for (char c : bytes)
+            add(c, low_sets);
+
+        prepare(low_sets);
     }
-    if (i < size && string[i] == delimiter) {
-        ++i;
-        while (i < size) {
-            parts.second += string[i];
-            ++i;
-        }
+
+    template<std::size_t N>
+    constexpr explicit Byte_class(std::array<char, N> bytes) noexcept
+    {
+        std::array<uint16_t, 16> low_sets{};
+        for (char c : bytes)
+            add(c, low_sets);
+
+        prepare(low_sets);
     }
-    return parts;
-}
 
-template<unsigned char delimiter>
-static inline std::string join(const std::vector<std::string>& vector)
-{
-    switch (vector.size()) {
-        case 0:
-            return {""};
+    /**
+     * Space, tab, line feed, carriage return, vertical tab and form feed.
+     */
+    static constexpr Byte_class whitespace() noexcept
+    {
+        return Byte_class{std::string_view{" \t\n\r\v\f"}};
+    }
+
+    constexpr bool contains(char c) const noexcept
+    {
+        auto u = static_cast<uint8_t>(c);
+        return (bitmap_[u >> 6] >> (u & 63)) & 1;
+    }
+
+    /**
+     * Like the std::string_view members of the same names, returns npos if there is no such byte.
+     */
+    std::size_t find_first_of(std::string_view v, std::size_t pos = 0) const noexcept;
+
+    std::size_t find_first_not_of(std::string_view v, std::size_t pos = 0) const noexcept;
+
+    std::size_t find_last_of(std::string_view v, std::size_t pos = std::string_view::npos) const noexcept;
 
-        case 1:
-            return vector.back();
+    std::size_t find_last_not_of(std::string_view v, std::size_t pos = std::string_view::npos) const noexcept;
 
-        default: {
-            assert(vector.size() >= 2);
+private:
 
-            size_t size = vector.size() - 1;
-            for (const std::string& string: vector)
-                size += string.size();
+    template<bool is_member>
+    std::size_t find_first(std::string_view v, std::size_t pos) const noexcept;
 
-            std::string out;
-            out.reserve(size);
+    template<bool is_member>
+    std::size_t find_last(std::string_view v, std::size_t pos) const noexcept;
 
-            auto it = vector.begin();
-            out = *it;
+    /**
+     * low_sets collects the low nibbles of the bytes by their high nibble.
+     */
+    constexpr void add(char c, std::array<uint16_t, 16>& low_sets) noexcept
+    {
+        auto u = static_cast<uint8_t>(c);
+        if (contains(c))
+            return;
+
+        bitmap_[u >> 6] |= uint64_t{1} << (u & 63);
+        low_sets[u >> 4] = static_cast<uint16_t>(low_sets[u >> 4] | (1u << (u & 15)));
+        if (byte_count_ < max_compared_bytes)
+            bytes_[byte_count_] = c;
+        ++byte_count_;
+    }
 
-            while (++it != vector.end()) {
-                out += delimiter;
-                out += *it;
+    constexpr void prepare(const std::array<uint16_t, 16>& low_sets) noexcept
+    {
+        std::array<uint16_t, 8> buckets{};
+        std::size_t bucket_count{0};
+        for (std::size_t high{0}; high != 16; ++high) {
+            if (!low_sets[high])
+                continue;
+
+            std::size_t bucket{0};
+            while (bucket != bucket_count && buckets[bucket] != low_sets[high])
+                ++bucket;
+
+            if (bucket == bucket_count) {
+                if (bucket_count == buckets.size())
+                    return;
+                buckets[bucket_count++] = low_sets[high];
             }
 
-            return out;
+            high_nibbles_[high] = static_cast<uint8_t>(1u << bucket);
+            for (std::size_t low{0}; low != 16; ++low) {
+                if ((low_sets[high] >> low) & 1)
+                    low_nibbles_[low] = static_cast<uint8_t>(low_nibbles_[low] | (1u << bucket));
+            }
         }
-    }
-}
 
-template<unsigned char delimiter, size_t Count>
-inline std::string join(const std::array<std::string, Count>& strings)
-{
-    if (strings.empty()) {
-        return {""};
+        has_nibble_tables_ = true;
     }
-    return std::accumulate(strings.begin() + 1, strings.end(), std::string{strings.front()}, [](auto& out, auto& in) {
-        out.push_back(delimiter);
-        out += in;
-        return out;
-    });
-}
 
-inline std::string join(const std::vector<std::string>& strings, std::string_view glue)
+    std::array<uint64_t, 4> bitmap_{};
+    std::array<uint8_t, 16> low_nibbles_{};
+    std::array<uint8_t, 16> high_nibbles_{};
+    bool has_nibble_tables_{false};
+    std::array<char, max_compared_bytes> bytes_{};
+    std::size_t byte_count_{0};
+};
+
+
+
+/**
+ * Trim all bytes of the class, e.g. Byte_class::whitespace().
+ */
+inline std::string_view trim_view(Utf8_view string, const Byte_class& trim_bytes) noexcept
 {
-    if (strings.empty()) {
-        return {""};
+    size_t first = trim_bytes.find_first_not_of(string.v_);
+    if (first == std::string_view::npos) {
+        return {};
     }
-    return std::accumulate(strings.begin() + 1, strings.end(), std::string{strings.front()}, [&](auto& out, auto& in) {
-        out += glue;
-        out += in;
-        return out;
-    });
+    size_t last = trim_bytes.find_last_not_of(string.v_);
+    return string.v_.substr(first, 1 + last - first);
 }
 
-inline std::vector<std::string> prefix(const std::vector<std::string>& strings, const std::string_view& prefix)
+inline std::string trim(const std::string& string, const Byte_class& trim_bytes)
 {
-    std::vector<std::string> prefixed_strings;
-    for (const std::string& string: strings) {
-        std::string t;
-        t.reserve(prefix.size() + string.size());
-        prefixed_strings.emplace_back((t += prefix) += string);
-    }
-    return prefixed_strings;
+    return std::string{trim_view(string, trim_bytes)};
+}
+
+
+
+/**
+ * Lazy split by a set of ASCII delimiter chars, the pieces are views into the string.
+ *
+ * Like split, n delimiters always give n + 1 pieces, possibly empty ones. ASCII delimiters never occur inside
+ * multi byte sequences, so splitting UTF-8 is safe. Delimiters are found with Byte_class.
+ */
+class Split_view {
+public:
+
+    class Iterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = const std::string_view&;
+
+        Iterator() noexcept = default;
+
+        Iterator(const Split_view* view, std::size_t begin) noexcept: view_{view}, begin_{begin}
+        {
+            if (begin_ != npos)
+                piece_ = view_->piece(begin_);
+        }
+
+        reference operator*() const noexcept
+        {
+            return piece_;
+        }
+
+        pointer operator->() const noexcept
+        {
+            return &piece_;
+        }
+
+        Iterator& operator++() noexcept
+        {
+            begin_ = view_->next_begin(begin_ + piece_.size());
+            if (begin_ != npos)
+                piece_ = view_->piece(begin_);
+
+            return *this;
+        }
+
+        Iterator operator++(int) noexcept
+        {
+            Iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const Iterator& other) const noexcept
+        {
+            return begin_ == other.begin_;
+        }
+
+        bool operator!=(const Iterator& other) const noexcept
+        {
+            return begin_ != other.begin_;
+        }
+
+    private:
+
+        static constexpr std::size_t npos = std::string_view::npos;
+
+        const Split_view* view_{nullptr};
+        std::size_t begin_{npos};
+        std::string_view piece_;
+    };
+
+
+    Split_view(Utf8_view string, char delimiter) noexcept: string_{string.v_}, delimiters_{std::array<char, 1>{delimiter}}
+    {
+    }
+
+    template<std::size_t N>
+    Split_view(Utf8_view string, std::array<char, N> delimiters) noexcept: string_{string.v_}, delimiters_{delimiters}
+    {
+    }
+
+    Split_view(Utf8_view string, const Byte_class& delimiters) noexcept: string_{string.v_}, delimiters_{delimiters}
+    {
+    }
+
+    /**
+     * Tokens are the non-empty pieces, runs of delimiters count as one and leading or trailing ones are ignored.
+     */
+    struct Tokens {};
+
+    Split_view(Utf8_view string, const Byte_class& delimiters, Tokens) noexcept: string_{string.v_}, delimiters_{delimiters}, is_tokens_{true}
+    {
+    }
+
+    Iterator begin() const noexcept
+    {
+        return {this, is_tokens_ ? delimiters_.find_first_not_of(string_) : 0};
+    }
+
+    Iterator end() const noexcept
+    {
+        return {};
+    }
+
+private:
+
+    std::string_view piece(std::size_t begin) const noexcept
+    {
+        return string_.substr(begin, std::min(delimiters_.find_first_of(string_, begin), string_.size()) - begin);
+    }
+
+    /**
+     * Begin of the piece after the one ending at end, or npos.
+     */
+    std::size_t next_begin(std::size_t end) const noexcept
+    {
+        if (is_tokens_)
+            return delimiters_.find_first_not_of(string_, end);
+
+        return end == string_.size() ? std::string_view::npos : end + 1;
+    }
+
+    std::string_view string_;
+    Byte_class delimiters_;
+    bool is_tokens_{false};
+};
+
+
+/**
+ * Lazy split by template-supplied delimiter char. The string must outlive the view.
+ */
+template<unsigned char delimiter>
+inline Split_view split_view(Utf8_view string) noexcept
+{
+    static constexpr Byte_class delimiters{std::array<char, 1>{static_cast<char>(delimiter)}};
+    return {string, delimiters};
+}
+
+/**
+ * Lazy split by delimiter chars. The string must outlive the view.
+ */
+template<std::size_t N>
+inline Split_view split_view(Utf8_view string, std::array<char, N> delimiters) noexcept
+{
+    return {string, delimiters};
+}
+
+
+/**
+ * Lazy split by a byte class. The string must outlive the view.
+ */
+inline Split_view split_view(Utf8_view string, const Byte_class& delimiters) noexcept
+{
+    return {string, delimiters};
+}
+
+
+/**
+ * Lazy split into tokens, the non-empty pieces between runs of delimiters. The string must outlive the view.
+ */
+inline Split_view tokenize_view(Utf8_view string, const Byte_class& delimiters) noexcept
+{
+    return {string, delimiters, Split_view::Tokens{}};
+}
+
+
+/**
+ * Split into views, reusing the storage of out.
+ */
+inline void split_into(const Split_view& view, std::vector<std::string_view>& out)
+{
+    out.clear();
+    for (auto piece : view)
+        out.push_back(piece);
+}
+
+template<unsigned char delimiter>
+inline void split_into(Utf8_view string, std::vector<std::string_view>& out)
+{
+    split_into(split_view<delimiter>(string), out);
+}
+
+template<std::size_t N>
+inline void split_into(Utf8_view string, std::array<char, N> delimiters, std::vector<std::string_view>& out)
+{
+    split_into(split_view(string, delimiters), out);
+}
+
+
+inline void split_into(Utf8_view string, const Byte_class& delimiters, std::vector<std::string_view>& out)
+{
+    split_into(split_view(string, delimiters), out);
+}
+
+inline void tokenize_into(Utf8_view string, const Byte_class& delimiters, std::vector<std::string_view>& out)
+{
+    split_into(tokenize_view(string, delimiters), out);
+}
+
+
+/**
+ * Split by template-supplied delimiter char.
+ */
+template<unsigned char delimiter>
+inline std::vector<std::string> split(const std::string& string)
+{
+    std::vector<std::string> parts;
+    for (auto piece : split_view<delimiter>(string))
+        parts.emplace_back(piece);
+    return parts;
+}
+
+/**
+ * Split by delimiter chars.
+ */
+template<std::size_t N>
+inline std::vector<std::string> split(const std::string& string, std::array<char, N> delimiters)
+{
+    std::vector<std::string> parts;
+    for (auto piece : split_view(string, delimiters))
+        parts.emplace_back(piece);
+    return parts;
+}
+
+/**
+ * Split once by template-supplied delimiter char, the parts are views into string. Without a delimiter the
+ * first part is the whole string and the second one is empty.
+ */
+template<unsigned char delimiter>
+inline std::pair<std::string_view, std::string_view> split_once_view(Utf8_view string) noexcept
+{
+    size_t i = string.v_.find(static_cast<char>(delimiter));
+    if (i == std::string_view::npos)
+        return {string.v_, {}};
+
+    return {string.v_.substr(0, i), string.v_.substr(i + 1)};
+}
+
+/**
+ * Split once by template-supplied delimiter char.
+ */
+template<unsigned char delimiter>
+inline std::pair<std::string, std::string> split_once(const std::string& string)
+{
+    auto [first, second] = split_once_view<delimiter>(string);
+    return {std::string{first}, std::string{second}};
+}
+
+/**
+ * Size of the strings of the range joined by separator.
+ */
+template<class Range>
+inline std::size_t joined_size(const Range& strings, std::string_view separator) noexcept
+{
+    std::size_t size{0};
+    std::size_t count{0};
+    for (const auto& string : strings) {
+        size += std::string_view{string}.size();
+        ++count;
+    }
+
+    return count ? size + (count - 1) * separator.size() : 0;
+}
+
+/**
+ * Write the strings of the range joined by separator to out, returns the end of the output.
+ *
+ * The items may be anything convertible to std::string_view, e.g. the pieces of a Split_view.
+ */
+template<class Range, class Output_iterator>
+inline Output_iterator join_to(const Range& strings, std::string_view separator, Output_iterator out)
+{
+    bool is_first{true};
+    for (const auto& string : strings) {
+        if (!is_first)
+            out = std::copy(separator.begin(), separator.end(), out);
+        is_first = false;
+
+        std::string_view v{string};
+        out = std::copy(v.begin(), v.end(), out);
+    }
+
+    return out;
+}
+
+/**
+ * Append the strings of the range joined by separator to out, growing it once by the exact size.
+ */
+template<class Range>
+inline void join_into(const Range& strings, std::string_view separator, std::string& out)
+{
+    std::size_t offset = out.size();
+    out.resize(offset + joined_size(strings, separator));
+    join_to(strings, separator, out.data() + offset);
+}
+
+template<class Range>
+inline std::string join(const Range& strings, std::string_view separator)
+{
+    std::string out;
+    join_into(strings, separator, out);
+    return out;
+}
+
+inline std::string join(const std::vector<std::string>& strings, std::string_view glue)
+{
+    return join<std::vector<std::string>>(strings, glue);
+}
+
+template<unsigned char delimiter>
+static inline std::string join(const std::vector<std::string>& vector)
+{
+    const char separator = static_cast<char>(delimiter);
+    return join(vector, std::string_view{&separator, 1});
+}
+
+template<unsigned char delimiter, size_t Count>
+inline std::string join(const std::array<std::string, Count>& strings)
+{
+    const char separator = static_cast<char>(delimiter);
+    return join(strings, std::string_view{&separator, 1});
+}
+
+inline std::vector<std::string> prefix(const std::vector<std::string>& strings, const std::string_view& prefix)
+{
+    std::vector<std::string> prefixed_strings;
+    for (const std::string& string: strings) {
+        std::string t;
+        t.reserve(prefix.size() + string.size());
+        prefixed_strings.emplace_back((t += prefix) += string);
+    }
+    return prefixed_strings;
 }
 
 template <size_t Count>
@@ -819,24 +1351,995 @@ inline std::array<std::string, Count> prefix(const std::array<std::string, Count
 }
 
 /**
- * Checks if needle (text to find) is in haystack (text which is searched) case insensitive.
+ * Prefixed strings in one contiguous buffer, two allocations in all instead of one per string.
+ *
+ * assign() reuses the buffers, so prefixing batch after batch doesn't allocate once they are large enough.
  */
-bool icontains(Utf8_view haystack, Utf8_view needle) noexcept;
+class Prefixed_strings {
+public:
 
-/**
- * Compare two utf8 strings case insensitive.
- */
-inline bool u8_iequal(Utf8_view v1, Utf8_view v2) noexcept
+    Prefixed_strings() noexcept = default;
+
+    template<class Range>
+    Prefixed_strings(const Range& strings, std::string_view prefix)
+    {
+        assign(strings, prefix);
+    }
+
+    template<class Range>
+    void assign(const Range& strings, std::string_view prefix)
+    {
+        std::size_t count{0};
+        std::size_t size{0};
+        for (const auto& string : strings) {
+            ++count;
+            size += prefix.size() + std::string_view{string}.size();
+        }
+
+        buffer_.clear();
+        buffer_.reserve(size);
+        ends_.clear();
+        ends_.reserve(count);
+        for (const auto& string : strings) {
+            buffer_ += prefix;
+            buffer_ += std::string_view{string};
+            ends_.push_back(buffer_.size());
+        }
+    }
+
+    std::size_t size() const noexcept
+    {
+        return ends_.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return ends_.empty();
+    }
+
+    std::string_view operator[](std::size_t i) const noexcept
+    {
+        std::size_t begin = i ? ends_[i - 1] : 0;
+        return std::string_view{buffer_}.substr(begin, ends_[i] - begin);
+    }
+
+    /**
+     * All prefixed strings back to back.
+     */
+    std::string_view buffer() const noexcept
+    {
+        return buffer_;
+    }
+
+private:
+
+    std::string buffer_;
+    std::vector<std::size_t> ends_;
+};
+
+template<class Range>
+inline Prefixed_strings prefix_flat(const Range& strings, std::string_view prefix)
 {
-    return v1.icompare(v2);
+    return Prefixed_strings{strings, prefix};
 }
 
 /**
- * Sort two utf8 strings case insensitive.
+ * Checks if needle (text to find) is in haystack (text which is searched) case insensitive.
+ *
+ * The needle is folded on the stack, only needles of more than 256 folded bytes allocate.
  */
-inline bool u8_iless(Utf8_view v1, Utf8_view v2) noexcept
-{
-    return v1.iless(v2);
-}
+bool icontains(Utf8_view haystack, Utf8_view needle);
+
+bool icontains(Validated_utf8_view haystack, Validated_utf8_view needle);
+
+struct Icase_match {
+    std::size_t begin;
+    std::size_t end;
+};
+
+
+/**
+ * A case insensitive search pattern, compiled once and matched against any number of haystacks.
+ *
+ * The pattern holds the folded needle and the search tables. It is immutable and copies share the compiled
+ * state, so it is cheap to copy and safe to use from several threads at once.
+ */
+class Icase_pattern {
+public:
+
+    explicit Icase_pattern(Utf8_view needle);
+
+    explicit Icase_pattern(Validated_utf8_view needle);
+
+    bool contains(Utf8_view haystack) const noexcept;
+
+    bool contains(Validated_utf8_view haystack) const noexcept;
+
+    /**
+     * Byte offsets of the first match in haystack. An empty pattern matches at the beginning.
+     */
+    std::optional<Icase_match> find(Utf8_view haystack) const noexcept;
+
+    std::optional<Icase_match> find(Validated_utf8_view haystack) const noexcept;
+
+    /**
+     * Byte offsets of all non-overlapping matches in haystack. An empty pattern matches once at the beginning.
+     */
+    std::vector<Icase_match> find_all(Utf8_view haystack) const;
+
+    std::vector<Icase_match> find_all(Validated_utf8_view haystack) const;
+
+    /**
+     * The lower cased needle.
+     */
+    std::string_view folded_needle() const noexcept;
+
+private:
+
+    struct Compiled;
+
+    std::shared_ptr<const Compiled> compiled_;
+};
+
+
+struct Icase_set_match {
+    std::size_t pattern;
+    std::size_t begin;
+    std::size_t end;
+};
 
 
+/**
+ * A set of case insensitive search patterns, all matched in a single pass over the haystack.
+ *
+ * The patterns are folded and compiled to an Aho-Corasick automaton, a DFA over the folded bytes. Like
+ * Icase_pattern it is immutable and copies share the compiled state. Patterns are reported by their index.
+ */
+class Icase_pattern_set {
+public:
+
+    explicit Icase_pattern_set(const std::vector<std::string>& patterns);
+
+    explicit Icase_pattern_set(const std::vector<std::string_view>& patterns);
+
+    Icase_pattern_set(std::initializer_list<std::string_view> patterns);
+
+    std::size_t pattern_count() const noexcept;
+
+    /**
+     * Does haystack contain at least one of the patterns? Stops at the first match.
+     */
+    bool contains_any(Utf8_view haystack) const noexcept;
+
+    bool contains_any(Validated_utf8_view haystack) const noexcept;
+
+    /**
+     * Sorted indices of the patterns found in haystack.
+     */
+    std::vector<std::size_t> matched_patterns(Utf8_view haystack) const;
+
+    std::vector<std::size_t> matched_patterns(Validated_utf8_view haystack) const;
+
+    /**
+     * All matches of all patterns including overlapping ones, ordered by their end. Empty patterns match once
+     * at the beginning.
+     */
+    std::vector<Icase_set_match> find_all(Utf8_view haystack) const;
+
+    std::vector<Icase_set_match> find_all(Validated_utf8_view haystack) const;
+
+private:
+
+    struct Compiled;
+
+    std::shared_ptr<const Compiled> compiled_;
+};
+
+
+/**
+ * Compare two utf8 strings case insensitive.
+ */
+inline bool u8_iequal(Utf8_view v1, Utf8_view v2) noexcept
+{
+    return v1.icompare(v2);
+}
+
+/**
+ * Sort two utf8 strings case insensitive.
+ */
+inline bool u8_iless(Utf8_view v1, Utf8_view v2) noexcept
+{
+    return v1.iless(v2);
+}
+
+
+
+
+/**
+ * Compare two validated utf8 strings case insensitive.
+ */
+bool u8_iequal(Validated_utf8_view v1, Validated_utf8_view v2) noexcept;
+
+/**
+ * Sort two validated utf8 strings case insensitive.
+ */
+bool u8_iless(Validated_utf8_view v1, Validated_utf8_view v2) noexcept;
+
+/**
+ * Three way case insensitive comparison: negative if v1 sorts before v2 like u8_iless, zero if they are equal like
+ * u8_iequal, positive otherwise. The byte identical prefix is skipped in vector sized steps.
+ */
+int u8_icompare3(Utf8_view v1, Utf8_view v2) noexcept;
+
+int u8_icompare3(Validated_utf8_view v1, Validated_utf8_view v2) noexcept;
+
+
+
+/**
+ * 64 bit hash of the lower cased string, consistent with u8_iequal: u8_iequal(v1, v2) implies
+ * u8_ihash(v1) == u8_ihash(v2). The string is folded and hashed chunk by chunk, nothing is allocated.
+ */
+uint64_t u8_ihash(Utf8_view v) noexcept;
+
+uint64_t u8_ihash(Validated_utf8_view v) noexcept;
+
+
+/**
+ * Transparent functors for case insensitive keys, e.g.
+ * std::unordered_set<std::string, Icase_hash, Icase_equal> or std::set<std::string, Icase_less>.
+ *
+ * Lookup by std::string_view, Utf8_view or string literals doesn't create a key. This needs C++20 for the
+ * unordered containers, the ordered ones support it since C++14.
+ */
+struct Icase_hash {
+    using is_transparent = void;
+
+    std::size_t operator()(Utf8_view v) const noexcept
+    {
+        return static_cast<std::size_t>(u8_ihash(v));
+    }
+};
+
+struct Icase_equal {
+    using is_transparent = void;
+
+    bool operator()(Utf8_view v1, Utf8_view v2) const noexcept
+    {
+        return u8_iequal(v1, v2);
+    }
+};
+
+struct Icase_less {
+    using is_transparent = void;
+
+    bool operator()(Utf8_view v1, Utf8_view v2) const noexcept
+    {
+        return u8_iless(v1, v2);
+    }
+};
+
+
+
+/**
+ * Compare two utf8 strings ignoring case and accents: letters of U+00C0 to U+00FF also equal their ASCII spelling,
+ * so "Müller" equals "muller", "Crème" equals "CREME" and "Straße" equals "strasse". ß and ẞ are spelled ss,
+ * æ ae and þ th, other code points are only lower cased.
+ */
+bool u8_accent_iequal(Utf8_view v1, Utf8_view v2) noexcept;
+
+bool u8_accent_iequal(Validated_utf8_view v1, Validated_utf8_view v2) noexcept;
+
+/**
+ * Sort two utf8 strings ignoring case and accents, in the byte order of their fold_to_ascii_key.
+ */
+bool u8_accent_iless(Utf8_view v1, Utf8_view v2) noexcept;
+
+bool u8_accent_iless(Validated_utf8_view v1, Validated_utf8_view v2) noexcept;
+
+int u8_accent_icompare3(Utf8_view v1, Utf8_view v2) noexcept;
+
+int u8_accent_icompare3(Validated_utf8_view v1, Validated_utf8_view v2) noexcept;
+
+/**
+ * Checks if needle is in haystack ignoring case and accents, e.g. "creme" is in "Crème brûlée". Like icontains,
+ * only needles of more than 256 folded bytes allocate.
+ */
+bool accent_icontains(Utf8_view haystack, Utf8_view needle);
+
+bool accent_icontains(Validated_utf8_view haystack, Validated_utf8_view needle);
+
+/**
+ * The string folded like u8_accent_iequal, to be built once per record so later checks are plain byte operations:
+ * keys are equal exactly when the strings are equal for u8_accent_iequal, memcmp orders them like u8_accent_iless
+ * and accent_icontains is a substring search of the needle key in the haystack key.
+ *
+ * Keys of Latin-1 text are ASCII, other code points stay lower cased UTF-8 and ill-formed sequences become U+FFFD.
+ */
+std::string fold_to_ascii_key(Utf8_view v);
+
+std::string fold_to_ascii_key(Validated_utf8_view v);
+
+
+/**
+ * Run a bulk operation on the calling thread only or on all hardware threads.
+ */
+enum class Execution {
+    sequential,
+    parallel
+};
+
+
+/**
+ * Binary sort key, comparing keys with memcmp (shorter first on a common prefix) orders like u8_iless.
+ *
+ * The key is the lower cased string: UTF-8 byte order is code point order, so comparing the keys compares the
+ * lower cased code points just like u8_iless does.
+ */
+std::string make_isort_key(Utf8_view v);
+
+std::string make_isort_key(Validated_utf8_view v);
+
+
+/**
+ * Indices of strings in u8_iless order, strings which are equal ignoring case keep their order.
+ *
+ * The sort keys are built once into a single buffer, then sorted by MSD radix sort over an array of their first
+ * eight bytes, falling back to comparing the whole keys only for small buckets and beyond the eighth byte.
+ */
+std::vector<std::size_t> u8_isort_order(const std::vector<std::string_view>& strings, Execution execution = Execution::sequential);
+
+
+/**
+ * Stable case insensitive sort of a random access range of strings, like std::stable_sort with u8_iless.
+ */
+template<class Range>
+void u8_isort(Range& strings, Execution execution = Execution::sequential)
+{
+    auto begin = std::begin(strings);
+    std::vector<std::string_view> views(begin, std::end(strings));
+    auto order = u8_isort_order(views, execution);
+
+    std::vector<std::decay_t<decltype(*begin)>> sorted;
+    sorted.reserve(order.size());
+    for (auto i : order)
+        sorted.push_back(std::move(begin[static_cast<std::ptrdiff_t>(i)]));
+
+    std::move(sorted.begin(), sorted.end(), begin);
+}
+
+
+
+struct Icase_completion {
+    /**
+     * Index of the entry in the range the index was built from.
+     */
+    std::size_t index;
+    std::string_view entry;
+    uint32_t weight;
+};
+
+
+/**
+ * Read-only case insensitive prefix index for autocomplete.
+ *
+ * The entries are stored by their lower cased keys in u8_iless order, so the entries which start with a prefix
+ * ignoring case are a range found by binary search. A max tree over the weights yields the top k of the range in
+ * O(k log n). Without weights the top k are the first ones in u8_iless order.
+ *
+ * The whole index is a single flat buffer, which buffer() returns for writing to a file and view() uses in place,
+ * e.g. memory mapped, without rebuilding. It is in host byte order, view() rejects buffers of other byte orders.
+ * Like Icase_pattern it is immutable and copies share the state.
+ */
+class Icase_prefix_index {
+public:
+
+    /**
+     * Index the entries, weights are empty or one per entry. Parallel execution lower cases, sorts and copies the
+     * entries on all hardware threads.
+     */
+    explicit Icase_prefix_index(const std::vector<std::string_view>& entries, const std::vector<uint32_t>& weights = {}, Execution execution = Execution::sequential);
+
+    /**
+     * Use a buffer() of an index in place, std::nullopt if it isn't one. The buffer must be 8 byte aligned, like
+     * memory mapped files are, and outlive the index and its copies.
+     */
+    static std::optional<Icase_prefix_index> view(std::string_view buffer) noexcept;
+
+    std::size_t size() const noexcept;
+
+    /**
+     * Number of entries which start with prefix case insensitive.
+     */
+    std::size_t count(Utf8_view prefix) const;
+
+    /**
+     * Up to k entries which start with prefix case insensitive, by descending weight and in u8_iless order among
+     * equal weights.
+     */
+    std::vector<Icase_completion> top_k(Utf8_view prefix, std::size_t k) const;
+
+    std::string_view buffer() const noexcept;
+
+private:
+
+    struct Layout;
+
+    explicit Icase_prefix_index(std::shared_ptr<const Layout> layout) noexcept;
+
+    std::shared_ptr<const Layout> layout_;
+};
+
+
+
+/**
+ * Splits a stream of UTF-8 chunks into pieces which hold only whole code points, so code point wise functions
+ * like case mapping and validation can run on the pieces as they arrive with the same result as on the whole.
+ *
+ * A sequence cut off at the end of a chunk (at most three bytes) is carried over and completed from the next
+ * one. Ill-formed sequences stay in the pieces as they are and decode to U+FFFD like in contiguous input.
+ *
+ *     Utf8_stream_decoder decoder;
+ *     for (auto chunk : chunks)
+ *         decoder.feed(chunk, [&](std::string_view piece) { ... });
+ *     decoder.finish([&](std::string_view piece) { ... });
+ */
+class Utf8_stream_decoder {
+public:
+
+    /**
+     * Call on_piece for the complete code points of pending and chunk, with one or two pieces.
+     */
+    template<class F>
+    void feed(std::string_view chunk, F&& on_piece)
+    {
+        if (pending_size_) {
+            std::size_t take = std::min(chunk.size(), pending_.size() - pending_size_);
+            // At most three bytes, copied one by one as chunk.data() may be null when chunk is empty
+            for (std::size_t i = 0; i != take; ++i)
+                pending_[pending_size_ + i] = chunk[i];
+            std::size_t size = pending_size_ + take;
+
+            std::size_t incomplete = incomplete_tail_size({pending_.data(), size});
+            if (incomplete == size) {
+                pending_size_ = size;
+                return;
+            }
+
+            // The pending bytes are a valid prefix, so the sequence ends within the bytes taken from chunk
+            std::size_t byte_count = decode_utf8(pending_.data(), size).byte_count;
+            on_piece(std::string_view{pending_.data(), byte_count});
+            chunk.remove_prefix(byte_count - pending_size_);
+            pending_size_ = 0;
+        }
+
+        std::size_t incomplete = incomplete_tail_size(chunk);
+        if (chunk.size() != incomplete)
+            on_piece(chunk.substr(0, chunk.size() - incomplete));
+
+        for (std::size_t i = 0; i != incomplete; ++i)
+            pending_[i] = chunk[chunk.size() - incomplete + i];
+        pending_size_ = incomplete;
+    }
+
+    /**
+     * End of the stream, a sequence still pending is incomplete and passed on as the last piece.
+     */
+    template<class F>
+    void finish(F&& on_piece)
+    {
+        if (pending_size_)
+            on_piece(std::string_view{pending_.data(), pending_size_});
+
+        pending_size_ = 0;
+    }
+
+    /**
+     * Number of bytes carried over to the next chunk.
+     */
+    std::size_t pending_size() const noexcept
+    {
+        return pending_size_;
+    }
+
+    /**
+     * Size of the sequence at the end of v which more bytes could still complete, 0 if v ends on a boundary.
+     */
+    static std::size_t incomplete_tail_size(std::string_view v) noexcept
+    {
+        for (std::size_t back{1}; back <= 3 && back <= v.size(); ++back) {
+            auto lead = static_cast<uint8_t>(v[v.size() - back]);
+            if ((lead & 0xC0) == 0x80)
+                continue;
+
+            std::size_t length = lead < 0xC2 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF5 ? 4 : 1;
+            bool is_cut_off = back < length && decode_utf8(v.data() + v.size() - back, back).byte_count == back;
+            return is_cut_off ? back : 0;
+        }
+
+        return 0;
+    }
+
+private:
+
+    std::array<char, 4> pending_;
+    std::size_t pending_size_{0};
+};
+
+
+/**
+ * Lower case a stream chunk by chunk, appending to out.
+ */
+class Utf8_stream_lower_caser {
+public:
+
+    void feed(std::string_view chunk, std::string& out)
+    {
+        decoder_.feed(chunk, [&](std::string_view piece) { to_lower_into(piece, out); });
+    }
+
+    void finish(std::string& out)
+    {
+        decoder_.finish([&](std::string_view piece) { to_lower_into(piece, out); });
+    }
+
+private:
+
+    Utf8_stream_decoder decoder_;
+};
+
+
+class Utf8_stream_upper_caser {
+public:
+
+    void feed(std::string_view chunk, std::string& out)
+    {
+        decoder_.feed(chunk, [&](std::string_view piece) { to_upper_into(piece, out); });
+    }
+
+    void finish(std::string& out)
+    {
+        decoder_.finish([&](std::string_view piece) { to_upper_into(piece, out); });
+    }
+
+private:
+
+    Utf8_stream_decoder decoder_;
+};
+
+
+/**
+ * Validate a stream chunk by chunk, error offsets count from the beginning of the stream.
+ */
+class Utf8_stream_validator {
+public:
+
+    /**
+     * False once the stream is known to be ill-formed, later chunks are ignored then.
+     */
+    bool feed(std::string_view chunk) noexcept;
+
+    /**
+     * The result for the whole stream, a sequence cut off by its end is an error.
+     */
+    Utf8_validation finish() noexcept;
+
+private:
+
+    void validate(std::string_view piece) noexcept;
+
+    Utf8_stream_decoder decoder_;
+    std::size_t offset_{0};
+    std::size_t error_offset_{std::string_view::npos};
+};
+
+
+/**
+ * Case insensitive search in a stream, also finds matches which span chunks.
+ *
+ * Matches cover as many code points as the folded needle has, so the last of them but one are kept to search
+ * across the next chunk boundary. Chunks themselves are searched in place.
+ */
+class Icase_stream_matcher {
+public:
+
+    explicit Icase_stream_matcher(Icase_pattern pattern);
+
+    /**
+     * True once the needle was found, later chunks are ignored then.
+     */
+    bool feed(std::string_view chunk);
+
+    bool finish();
+
+    bool is_found() const noexcept
+    {
+        return is_found_;
+    }
+
+private:
+
+    void search(std::string_view piece);
+
+    Icase_pattern pattern_;
+    std::size_t overlap_code_points_;
+    Utf8_stream_decoder decoder_;
+    std::string carry_;
+    std::string seam_;
+    bool is_found_;
+};
+
+
+/**
+ * Checks if the chunks, taken as one stream, contain needle case insensitive.
+ */
+template<class Range>
+bool icontains_stream(const Range& chunks, Utf8_view needle)
+{
+    Icase_stream_matcher matcher{Icase_pattern{needle}};
+    for (const auto& chunk : chunks) {
+        if (matcher.feed(chunk))
+            return true;
+    }
+
+    return matcher.finish();
+}
+
+
+
+/**
+ * A line containing a case insensitive match, with the first match in it. Offsets count from the start of the text.
+ */
+struct Icase_line_match {
+    std::size_t line_number;
+    std::size_t line_begin;
+    std::size_t match_begin;
+    std::size_t match_end;
+};
+
+
+/**
+ * All lines of text which contain pattern, like grep -i, in order. Matches don't span lines.
+ *
+ * With Execution::parallel the text is split into one chunk per thread of Thread_pool::shared() at line breaks,
+ * which are code point boundaries too, and the chunks are searched independently.
+ */
+std::vector<Icase_line_match> icase_grep(Utf8_view text, const Icase_pattern& pattern, Execution execution = Execution::sequential);
+
+
+/**
+ * icase_grep over a memory mapped file, std::nullopt if it can't be opened or mapped.
+ *
+ * The file is searched in windows of window_size bytes, ending at line breaks. The pages of a window are
+ * released once it is searched, so memory usage stays at about one window however large the file is.
+ */
+std::optional<std::vector<Icase_line_match>> icase_grep_file(const char* path, const Icase_pattern& pattern, Execution execution = Execution::sequential, std::size_t window_size = std::size_t{256} << 20);
+
+
+
+/**
+ * Edit operations counted by the edit distances.
+ */
+enum class Edit_distance {
+    /**
+     * Insertions, deletions and substitutions of code points.
+     */
+    levenshtein,
+
+    /**
+     * Also transpositions of adjacent code points, as long as no code point is edited again (optimal string
+     * alignment, so "ca" to "abc" is 3).
+     */
+    damerau
+};
+
+
+/**
+ * Edit distance of the lower cased code points, so code points which are equal for Unicode_code_point::icompare
+ * don't count. Ill-formed sequences are U+FFFD.
+ *
+ * Returns npos if the distance is greater than max_distance, which ends the computation as soon as the distance
+ * can't get down to it anymore. Uses Myers' bit-parallel algorithm, which updates 64 pattern code points per word
+ * operation. Only if both strings have more than 64 code points it allocates.
+ */
+std::size_t u8_iedit_distance(Utf8_view v1, Utf8_view v2, std::size_t max_distance = std::string_view::npos, Edit_distance metric = Edit_distance::levenshtein);
+
+
+/**
+ * A pattern for u8_iedit_distance, compiled once and compared with any number of texts, e.g. for "did you mean"
+ * suggestions. Patterns of any length are supported, longer ones take a word per 64 code points. Like
+ * Icase_pattern it is immutable and copies share the compiled state.
+ */
+class Fuzzy_pattern {
+public:
+
+    explicit Fuzzy_pattern(Utf8_view pattern, Edit_distance metric = Edit_distance::levenshtein);
+
+    /**
+     * Like u8_iedit_distance(pattern, text, max_distance, metric). Allocates only for patterns of more than 512
+     * code points.
+     */
+    std::size_t distance(Utf8_view text, std::size_t max_distance = std::string_view::npos) const;
+
+    std::size_t code_point_count() const noexcept;
+
+private:
+
+    struct Compiled;
+
+    std::shared_ptr<const Compiled> compiled_;
+};
+
+
+
+/**
+ * Runs a batch of tasks, possibly in parallel. Callers may supply their own to run the batch APIs on it.
+ */
+class Executor {
+public:
+
+    virtual ~Executor() = default;
+
+    /**
+     * Call task(i) for every i in [0, task_count) and return once all calls returned.
+     *
+     * If a task throws, the remaining tasks may be skipped and run() rethrows the first exception once the
+     * running ones returned.
+     */
+    virtual void run(std::size_t task_count, const std::function<void(std::size_t)>& task) = 0;
+};
+
+
+/**
+ * Work stealing thread pool, the calling thread works on the batch too.
+ *
+ * Every thread starts with an equal range of the task indices and takes tasks from its front. Threads which
+ * run out steal the back half of the range of another one, so uneven tasks still keep all threads busy. One
+ * batch runs at a time, batches started from within a task run on the calling thread.
+ */
+class Thread_pool : public Executor {
+public:
+
+    /**
+     * thread_count includes the calling thread, so a pool of one thread runs everything on it.
+     */
+    explicit Thread_pool(std::size_t thread_count);
+
+    ~Thread_pool() override;
+
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    void run(std::size_t task_count, const std::function<void(std::size_t)>& task) override;
+
+    std::size_t thread_count() const noexcept;
+
+    /**
+     * The pool used for Execution::parallel, with one thread per core.
+     */
+    static Thread_pool& shared();
+
+private:
+
+    struct State;
+
+    std::unique_ptr<State> state_;
+};
+
+
+/**
+ * Batch APIs: one operation over many strings, split into tasks of batch_grain_size strings.
+ *
+ * Results go to caller sized outputs which keep their capacity between batches, they are never resized. Bitmaps
+ * hold the result for string i in bit i % 64 of word i / 64.
+ */
+constexpr std::size_t batch_grain_size = 1024;
+
+/**
+ * Number of bitmap words for string_count strings.
+ */
+constexpr std::size_t batch_bitmap_size(std::size_t string_count) noexcept
+{
+    return (string_count + 63) / 64;
+}
+
+/**
+ * The strings of a batch: a random access range of items convertible to std::string_view, e.g. a vector of
+ * std::string or of std::string_view, used in place. The range has to outlive the batch call.
+ */
+class Batch_strings {
+public:
+
+    Batch_strings() noexcept = default;
+
+    template<class Range>
+    Batch_strings(const Range& strings) noexcept:
+        range_{&strings},
+        size_{static_cast<std::size_t>(std::size(strings))},
+        at_{[](const void* range, std::size_t i) noexcept {
+            return std::string_view{std::begin(*static_cast<const Range*>(range))[static_cast<std::ptrdiff_t>(i)]};
+        }}
+    {
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    std::string_view operator[](std::size_t i) const noexcept
+    {
+        return at_(range_, i);
+    }
+
+private:
+
+    const void* range_{nullptr};
+    std::size_t size_{0};
+    std::string_view (*at_)(const void* range, std::size_t i) noexcept{nullptr};
+};
+
+/**
+ * Lower case every string into out[i], out must have one string per input string.
+ */
+void batch_to_lower(Batch_strings strings, std::vector<std::string>& out, Execution execution = Execution::sequential);
+
+void batch_to_lower(Batch_strings strings, std::vector<std::string>& out, Executor& executor);
+
+/**
+ * Bitmap of the strings which contain pattern case insensitive, matches must have batch_bitmap_size(strings.size()) words.
+ */
+void batch_icontains(Batch_strings strings, const Icase_pattern& pattern, std::vector<uint64_t>& matches, Execution execution = Execution::sequential);
+
+void batch_icontains(Batch_strings strings, const Icase_pattern& pattern, std::vector<uint64_t>& matches, Executor& executor);
+
+/**
+ * Bitmap of the strings which are equal to key case insensitive, matches must have batch_bitmap_size(strings.size()) words.
+ */
+void batch_iequal(Batch_strings strings, Utf8_view key, std::vector<uint64_t>& matches, Execution execution = Execution::sequential);
+
+void batch_iequal(Batch_strings strings, Utf8_view key, std::vector<uint64_t>& matches, Executor& executor);
+
+/**
+ * Edit distance of every string to pattern like Fuzzy_pattern::distance, distances must have one per string.
+ */
+void batch_iedit_distance(Batch_strings strings, const Fuzzy_pattern& pattern, std::size_t max_distance, std::vector<std::size_t>& distances, Execution execution = Execution::sequential);
+
+void batch_iedit_distance(Batch_strings strings, const Fuzzy_pattern& pattern, std::size_t max_distance, std::vector<std::size_t>& distances, Executor& executor);
+
+
+
+/**
+ * Instruction set levels of the vectorized kernels for validation, case conversion, comparison, search and
+ * counting. Every level is compiled into the library, the best one the CPU supports is chosen on first use.
+ *
+ * The environment variable AUDAKI_U8STRING_SIMD_LEVEL (scalar, sse2, sse4.2 or avx2) caps the level chosen on
+ * first use, set_simd_level() switches it at any time, e.g. to compare the levels in tests and benchmarks. CPUs
+ * with AVX-512 run the AVX2 kernels. Builds for other architectures than x86 only have the scalar level.
+ */
+enum class Simd_level {
+    scalar,
+    sse2,
+    sse42,
+    avx2
+};
+
+Simd_level simd_level() noexcept;
+
+/**
+ * The best level supported by the CPU.
+ */
+Simd_level max_simd_level() noexcept;
+
+/**
+ * Use the kernels of level from now on, returns false and keeps the current ones if the CPU doesn't support it.
+ */
+bool set_simd_level(Simd_level level) noexcept;
+
+
+
+/**
+ * Bulk transcoding between UTF-8 and Latin-1, Windows-1252, UTF-16 and UTF-32.
+ *
+ * UTF-16 is UTF-16LE on every host, big endian hosts swap the code units. UTF-32 is in host byte order. The
+ * *_size functions compute the exact output size of valid input (an upper bound otherwise), so the pointer
+ * overloads can write to a buffer of that size. Conversions stop at the first error.
+ *
+ * ASCII runs are found and copied, widened or narrowed with the SIMD kernels, as is the Latin-1 check of UTF-16
+ * and UTF-32. All other characters, including the non-ASCII bytes of Latin-1 and Windows-1252, are converted one
+ * by one.
+ */
+struct Transcode_result {
+
+    /**
+     * Offset in code units of the input at which the conversion stopped, std::string_view::npos if it converted all.
+     */
+    std::size_t error_offset;
+
+    /**
+     * Number of code units written, all of them belong to the input before error_offset.
+     */
+    std::size_t written;
+
+    explicit operator bool() const noexcept
+    {
+        return error_offset == std::string_view::npos;
+    }
+};
+
+
+std::size_t latin1_to_utf8_size(std::string_view latin1) noexcept;
+
+/**
+ * Every byte is the code point of the same value, this can't fail.
+ */
+std::size_t latin1_to_utf8(std::string_view latin1, char* out) noexcept;
+
+std::string latin1_to_utf8(std::string_view latin1);
+
+
+std::size_t windows1252_to_utf8_size(std::string_view windows1252) noexcept;
+
+/**
+ * Like Latin-1 with 0x80 to 0x9F mapped to €, curly quotes, dashes and some more letters. The five unassigned
+ * bytes become the C1 controls of the same value like in the WHATWG encoding standard, so this can't fail.
+ */
+std::size_t windows1252_to_utf8(std::string_view windows1252, char* out) noexcept;
+
+std::string windows1252_to_utf8(std::string_view windows1252);
+
+
+/**
+ * Is v valid UTF-8 of code points up to U+00FF only? ẞ is not in Latin-1.
+ */
+bool fits_latin1(Utf8_view v) noexcept;
+
+bool fits_latin1(std::u16string_view utf16) noexcept;
+
+bool fits_latin1(std::u32string_view utf32) noexcept;
+
+std::size_t utf8_to_latin1_size(Utf8_view v) noexcept;
+
+/**
+ * Fails on ill-formed UTF-8 and on code points above U+00FF.
+ */
+Transcode_result utf8_to_latin1(Utf8_view v, char* out) noexcept;
+
+std::optional<std::string> utf8_to_latin1(Utf8_view v);
+
+
+std::size_t utf8_to_utf16_size(Utf8_view v) noexcept;
+
+/**
+ * Fails on ill-formed UTF-8.
+ */
+Transcode_result utf8_to_utf16(Utf8_view v, char16_t* out) noexcept;
+
+std::optional<std::u16string> utf8_to_utf16(Utf8_view v);
+
+std::size_t utf16_to_utf8_size(std::u16string_view utf16) noexcept;
+
+/**
+ * Fails on unpaired surrogates.
+ */
+Transcode_result utf16_to_utf8(std::u16string_view utf16, char* out) noexcept;
+
+std::optional<std::string> utf16_to_utf8(std::u16string_view utf16);
+
+
+std::size_t utf8_to_utf32_size(Utf8_view v) noexcept;
+
+/**
+ * Fails on ill-formed UTF-8.
+ */
+Transcode_result utf8_to_utf32(Utf8_view v, char32_t* out) noexcept;
+
+std::optional<std::u32string> utf8_to_utf32(Utf8_view v);
+
+std::size_t utf32_to_utf8_size(std::u32string_view utf32) noexcept;
+
+/**
+ * Fails on surrogates and values above U+10FFFF.
+ */
+Transcode_result utf32_to_utf8(std::u32string_view utf32, char* out) noexcept;
+
+std::optional<std::string> utf32_to_utf8(std::u32string_view utf32);
@@ -0,0 +1,187 @@
+#include "audaki/u8string.h"
+
+#include "audaki/decoder.h"
+#include "audaki/icase_search.h"
+
+
+
+namespace {
+
+using u8_decoder::Checked;
+using u8_decoder::Unchecked;
+using u8_search::Accent_folding;
+
+
+
+/**
+ * Reads the accent folded bytes of a string one at a time, the folding of a code point is kept until it is read.
+ */
+template<class Decoder>
+class Accent_folded_reader {
+public:
+
+    explicit Accent_folded_reader(std::string_view v) noexcept: v_{v}
+    {
+    }
+
+    /**
+     * Is nothing of a folded code point left, so the next byte begins a code point of the string?
+     */
+    bool is_at_code_point() const noexcept
+    {
+        return folded_pos_ == folded_size_;
+    }
+
+    const char* data() const noexcept
+    {
+        return v_.data() + pos_;
+    }
+
+    std::size_t remaining() const noexcept
+    {
+        return v_.size() - pos_;
+    }
+
+    void skip(std::size_t n) noexcept
+    {
+        pos_ += n;
+    }
+
+    /**
+     * The next folded byte or -1 at the end.
+     */
+    int next() noexcept
+    {
+        if (folded_pos_ != folded_size_)
+            return static_cast<uint8_t>(folded_[folded_pos_++]);
+
+        if (pos_ == v_.size())
+            return -1;
+
+        auto byte = static_cast<uint8_t>(v_[pos_]);
+        if (byte < 0x80) {
+            ++pos_;
+            return static_cast<uint8_t>(u8_case::lower_latin1[byte]);
+        }
+
+        auto folded = Accent_folding::fold_code_point<Decoder>(v_.data() + pos_, v_.size() - pos_, folded_.data());
+        pos_ += folded.consumed;
+        folded_size_ = folded.produced;
+        folded_pos_ = 1;
+        return static_cast<uint8_t>(folded_[0]);
+    }
+
+private:
+
+    std::string_view v_;
+    std::size_t pos_{0};
+    std::array<char, 4> folded_{};
+    std::size_t folded_pos_{0};
+    std::size_t folded_size_{0};
+};
+
+
+/**
+ * Compare the accent folded keys without building them, the shorter key is less on a common prefix.
+ */
+template<class Decoder>
+int accent_icompare3_impl(std::string_view v1, std::string_view v2) noexcept
+{
+    auto ascii_iequal_run_length = u8_simd::kernels().ascii_iequal_run_length;
+    Accent_folded_reader<Decoder> reader1{v1};
+    Accent_folded_reader<Decoder> reader2{v2};
+
+    while (true) {
+        // ASCII folds to its lower case, so runs which are equal ignoring case are skipped in bulk
+        if (reader1.is_at_code_point() && reader2.is_at_code_point()) {
+            std::size_t skip = ascii_iequal_run_length(reader1.data(), reader2.data(), std::min(reader1.remaining(), reader2.remaining()));
+            reader1.skip(skip);
+            reader2.skip(skip);
+        }
+
+        int b1 = reader1.next();
+        int b2 = reader2.next();
+        if (b1 != b2)
+            return b1 < b2 ? -1 : 1;
+
+        if (b1 < 0)
+            return 0;
+    }
+}
+
+
+template<class Decoder>
+bool accent_icontains_impl(std::string_view haystack, std::string_view needle)
+{
+    u8_search::Folded_needle<Decoder, Accent_folding> folded_needle{needle};
+    if (folded_needle.view().empty())
+        return true;
+
+    // Unlike lower casing, non-ASCII letters fold to ASCII, so even single bytes need the folded haystack
+    return u8_search::contains_folded<Decoder, Accent_folding>(haystack, u8_search::Searcher{folded_needle.view()});
+}
+
+}
+
+
+
+bool u8_accent_iequal(Utf8_view v1, Utf8_view v2) noexcept
+{
+    return accent_icompare3_impl<Checked>(v1.v_, v2.v_) == 0;
+}
+
+
+bool u8_accent_iequal(Validated_utf8_view v1, Validated_utf8_view v2) noexcept
+{
+    return accent_icompare3_impl<Unchecked>(v1.string_view(), v2.string_view()) == 0;
+}
+
+
+bool u8_accent_iless(Utf8_view v1, Utf8_view v2) noexcept
+{
+    return accent_icompare3_impl<Checked>(v1.v_, v2.v_) < 0;
+}
+
+
+bool u8_accent_iless(Validated_utf8_view v1, Validated_utf8_view v2) noexcept
+{
+    return accent_icompare3_impl<Unchecked>(v1.string_view(), v2.string_view()) < 0;
+}
+
+
+int u8_accent_icompare3(Utf8_view v1, Utf8_view v2) noexcept
+{
+    return accent_icompare3_impl<Checked>(v1.v_, v2.v_);
+}
+
+
+int u8_accent_icompare3(Validated_utf8_view v1, Validated_utf8_view v2) noexcept
+{
+    return accent_icompare3_impl<Unchecked>(v1.string_view(), v2.string_view());
+}
+
+
+
+bool accent_icontains(Utf8_view haystack, Utf8_view needle)
+{
+    return accent_icontains_impl<Checked>(haystack.v_, needle.v_);
+}
+
+
+bool accent_icontains(Validated_utf8_view haystack, Validated_utf8_view needle)
+{
+    return accent_icontains_impl<Unchecked>(haystack.string_view(), needle.string_view());
+}
+
+
+
+std::string fold_to_ascii_key(Utf8_view v)
+{
+    return u8_search::fold<Checked, Accent_folding>(v.v_);
+}
+
+
+std::string fold_to_ascii_key(Validated_utf8_view v)
+{
+    return u8_search::fold<Unchecked, Accent_folding>(v.string_view());
+}
@@ -0,0 +1,124 @@
+#include "audaki/u8string.h"
+
+
+
+namespace {
+
+static_assert(batch_grain_size % 64 == 0, "tasks must own whole bitmap words");
+
+
+/**
+ * Run body(begin, end) for the strings of every task, tasks are batch_grain_size strings.
+ */
+template <typename Body>
+void run_batch(Executor& executor, std::size_t size, Body&& body)
+{
+    std::size_t task_count = (size + batch_grain_size - 1) / batch_grain_size;
+    executor.run(task_count, [&](std::size_t task_index) {
+        std::size_t begin = task_index * batch_grain_size;
+        body(begin, std::min(size, begin + batch_grain_size));
+    });
+}
+
+
+/**
+ * Bitmap of the strings for which predicate holds, every task writes its own words.
+ */
+template <typename Predicate>
+void batch_bitmap(Batch_strings strings, std::vector<uint64_t>& matches, Executor& executor, Predicate&& predicate)
+{
+    assert(matches.size() == batch_bitmap_size(strings.size()));
+    run_batch(executor, strings.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t word = begin / 64; word != batch_bitmap_size(end); ++word) {
+            uint64_t bits{0};
+            for (std::size_t i = word * 64; i != std::min(end, word * 64 + 64); ++i)
+                bits |= uint64_t{predicate(strings[i])} << (i % 64);
+            matches[word] = bits;
+        }
+    });
+}
+
+
+/**
+ * Runs all tasks on the calling thread.
+ */
+class Inline_executor : public Executor {
+public:
+
+    void run(std::size_t task_count, const std::function<void(std::size_t)>& task) override
+    {
+        for (std::size_t i{0}; i != task_count; ++i)
+            task(i);
+    }
+};
+
+
+Executor& executor_for(Execution execution)
+{
+    static Inline_executor inline_executor;
+    if (execution == Execution::parallel)
+        return Thread_pool::shared();
+
+    return inline_executor;
+}
+
+}
+
+
+
+void batch_to_lower(Batch_strings strings, std::vector<std::string>& out, Execution execution)
+{
+    batch_to_lower(strings, out, executor_for(execution));
+}
+
+
+void batch_to_lower(Batch_strings strings, std::vector<std::string>& out, Executor& executor)
+{
+    assert(out.size() == strings.size());
+    run_batch(executor, strings.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            out[i].clear();
+            to_lower_into(strings[i], out[i]);
+        }
+    });
+}
+
+
+void batch_icontains(Batch_strings strings, const Icase_pattern& pattern, std::vector<uint64_t>& matches, Execution execution)
+{
+    batch_icontains(strings, pattern, matches, executor_for(execution));
+}
+
+
+void batch_icontains(Batch_strings strings, const Icase_pattern& pattern, std::vector<uint64_t>& matches, Executor& executor)
+{
+    batch_bitmap(strings, matches, executor, [&](std::string_view v) { return pattern.contains(v); });
+}
+
+
+void batch_iequal(Batch_strings strings, Utf8_view key, std::vector<uint64_t>& matches, Execution execution)
+{
+    batch_iequal(strings, key, matches, executor_for(execution));
+}
+
+
+void batch_iequal(Batch_strings strings, Utf8_view key, std::vector<uint64_t>& matches, Executor& executor)
+{
+    batch_bitmap(strings, matches, executor, [&](std::string_view v) { return u8_iequal(v, key); });
+}
+
+
+void batch_iedit_distance(Batch_strings strings, const Fuzzy_pattern& pattern, std::size_t max_distance, std::vector<std::size_t>& distances, Execution execution)
+{
+    batch_iedit_distance(strings, pattern, max_distance, distances, executor_for(execution));
+}
+
+
+void batch_iedit_distance(Batch_strings strings, const Fuzzy_pattern& pattern, std::size_t max_distance, std::vector<std::size_t>& distances, Executor& executor)
+{
+    assert(distances.size() == strings.size());
+    run_batch(executor, strings.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i)
+            distances[i] = pattern.distance(strings[i], max_distance);
+    });
+}
@@ -0,0 +1,77 @@
+#include "audaki/u8string.h"
+
+#include "audaki/simd_kernels.h"
+
+
+
+template<bool is_member>
+std::size_t Byte_class::find_first(std::string_view v, std::size_t pos) const noexcept
+{
+    if (pos >= v.size())
+        return std::string_view::npos;
+
+    const char* s = v.data() + pos;
+    std::size_t n = v.size() - pos;
+
+    if (is_member && byte_count_ == 1) {
+        const void* found = std::memchr(s, bytes_[0], n);
+        return found ? static_cast<std::size_t>(static_cast<const char*>(found) - v.data()) : std::string_view::npos;
+    }
+
+    u8_simd::Class_tables tables{
+        bitmap_.data(),
+        has_nibble_tables_ ? low_nibbles_.data() : nullptr,
+        has_nibble_tables_ ? high_nibbles_.data() : nullptr,
+        byte_count_ <= max_compared_bytes ? bytes_.data() : nullptr,
+        byte_count_};
+
+    const auto& kernels = u8_simd::kernels();
+    std::size_t found = is_member ? kernels.find_first_of_class(s, n, tables) : kernels.find_first_not_of_class(s, n, tables);
+    return found == n ? std::string_view::npos : pos + found;
+}
+
+
+template<bool is_member>
+std::size_t Byte_class::find_last(std::string_view v, std::size_t pos) const noexcept
+{
+    if (v.empty())
+        return std::string_view::npos;
+
+    std::size_t n = std::min(pos, v.size() - 1) + 1;
+
+    u8_simd::Class_tables tables{
+        bitmap_.data(),
+        has_nibble_tables_ ? low_nibbles_.data() : nullptr,
+        has_nibble_tables_ ? high_nibbles_.data() : nullptr,
+        byte_count_ <= max_compared_bytes ? bytes_.data() : nullptr,
+        byte_count_};
+
+    const auto& kernels = u8_simd::kernels();
+    std::size_t found = is_member ? kernels.find_last_of_class(v.data(), n, tables) : kernels.find_last_not_of_class(v.data(), n, tables);
+    return found == n ? std::string_view::npos : found;
+}
+
+
+
+std::size_t Byte_class::find_first_of(std::string_view v, std::size_t pos) const noexcept
+{
+    return find_first<true>(v, pos);
+}
+
+
+std::size_t Byte_class::find_first_not_of(std::string_view v, std::size_t pos) const noexcept
+{
+    return find_first<false>(v, pos);
+}
+
+
+std::size_t Byte_class::find_last_of(std::string_view v, std::size_t pos) const noexcept
+{
+    return find_last<true>(v, pos);
+}
+
+
+std::size_t Byte_class::find_last_not_of(std::string_view v, std::size_t pos) const noexcept
+{
+    return find_last<false>(v, pos);
+}
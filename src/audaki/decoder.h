@@ -0,0 +1,55 @@
+#pragma once
+
+#include "audaki/u8string.h"
+
+
+
+/**
+ * Decoding policies, the algorithms are templates over these so validated input skips all checks.
+ */
+namespace u8_decoder {
+
+
+/**
+ * Decoding policy for arbitrary input, ill-formed sequences become U+FFFD.
+ */
+struct Checked {
+    static Utf8_decoded decode(const char* p, std::size_t n) noexcept
+    {
+        return decode_utf8(p, n);
+    }
+};
+
+
+/**
+ * Decoding policy for input which passed validate_utf8, no bounds checks at all.
+ */
+struct Unchecked {
+    static Utf8_decoded decode(const char* p, std::size_t) noexcept
+    {
+        return decode_valid_utf8(p);
+    }
+};
+
+
+
+/**
+ * Is p the two byte sequence of one of U+00C0 to U+00FF? These are well-formed for either policy and the case
+ * mapping tables in u8_case work on them directly.
+ */
+inline bool is_c3_sequence(const char* p, std::size_t n) noexcept
+{
+    return n >= 2 && static_cast<uint8_t>(p[0]) == 0xC3 && (static_cast<uint8_t>(p[1]) & 0xC0) == 0x80;
+}
+
+
+/**
+ * Second byte of the lower case of a C3 sequence.
+ */
+inline char lower_c3(char second) noexcept
+{
+    return static_cast<char>(u8_case::lower_c3[static_cast<uint8_t>(second) & 0x3F]);
+}
+
+
+}
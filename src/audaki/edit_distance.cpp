@@ -0,0 +1,450 @@
+#include "audaki/u8string.h"
+
+#include "audaki/simd_kernels.h"
+
+#include <algorithm>
+
+
+
+namespace {
+
+/**
+ * Lower cased non-ASCII code point at pos, advances pos past it.
+ */
+uint32_t next_folded_non_ascii(std::string_view v, std::size_t& pos) noexcept
+{
+    auto decoded = decode_utf8(v.data() + pos, v.size() - pos);
+    pos += decoded.byte_count;
+    return decoded.code_point.as_lower_case().v_;
+}
+
+
+/**
+ * Lower cased code point at pos, advances pos past it. The ASCII case is kept small enough to be inlined.
+ */
+inline uint32_t next_folded_code_point(std::string_view v, std::size_t& pos) noexcept
+{
+    auto byte = static_cast<uint8_t>(v[pos]);
+    if (byte >= 0x80)
+        return next_folded_non_ascii(v, pos);
+
+    ++pos;
+    return u8_case::lower_latin1[byte];
+}
+
+
+/**
+ * Number of code points of v as they are folded, ill-formed sequences count once per U+FFFD.
+ */
+std::size_t folded_length(std::string_view v) noexcept
+{
+    std::size_t length{0};
+    for (std::size_t pos{0}; pos != v.size(); ++length)
+        next_folded_code_point(v, pos);
+
+    return length;
+}
+
+
+/**
+ * Match masks of a pattern of up to 64 code points: bit i of the mask of c is set if the i-th folded code point of
+ * the pattern is c. One per thread is reused, so instead of zero filling the whole table every time, assign only
+ * clears the entries the previous pattern set.
+ */
+class Word_masks {
+public:
+
+    /**
+     * Fails if v has more than 64 code points.
+     */
+    bool assign(std::string_view v) noexcept
+    {
+        clear();
+        if (v.size() > 64 * 4)
+            return false;
+
+        for (std::size_t pos{0}; pos != v.size(); ++length_) {
+            if (length_ == 64)
+                return false;
+
+            uint64_t bit = uint64_t{1} << length_;
+            uint32_t c = next_folded_code_point(v, pos);
+            if (c <= 0xFF) {
+                if (!latin1_[c])
+                    set_latin1_[set_latin1_count_++] = static_cast<uint8_t>(c);
+                latin1_[c] |= bit;
+                continue;
+            }
+
+            std::size_t i{0};
+            while (i != other_count_ && others_[i] != c)
+                ++i;
+
+            if (i == other_count_) {
+                others_[other_count_++] = c;
+                other_masks_[i] = 0;
+            }
+            other_masks_[i] |= bit;
+        }
+
+        return true;
+    }
+
+    const uint64_t* get(uint32_t c) const noexcept
+    {
+        if (c <= 0xFF)
+            return &latin1_[c];
+
+        for (std::size_t i{0}; i != other_count_; ++i) {
+            if (others_[i] == c)
+                return &other_masks_[i];
+        }
+
+        return &zero_;
+    }
+
+    std::size_t length() const noexcept
+    {
+        return length_;
+    }
+
+private:
+
+    void clear() noexcept
+    {
+        for (std::size_t i{0}; i != set_latin1_count_; ++i)
+            latin1_[set_latin1_[i]] = 0;
+
+        set_latin1_count_ = 0;
+        other_count_ = 0;
+        length_ = 0;
+    }
+
+    std::array<uint64_t, 256> latin1_{};
+    std::array<uint8_t, 64> set_latin1_{};
+    std::array<uint32_t, 64> others_{};
+    std::array<uint64_t, 64> other_masks_{};
+    std::size_t set_latin1_count_{0};
+    std::size_t other_count_{0};
+    std::size_t length_{0};
+    uint64_t zero_{0};
+};
+
+
+thread_local Word_masks thread_word_masks;
+
+
+/**
+ * Match masks of a pattern of any length in words of 64 code points, the words of a code point are adjacent.
+ */
+class Block_masks {
+public:
+
+    explicit Block_masks(std::string_view v)
+    {
+        std::vector<uint32_t> code_points;
+        code_points.reserve(v.size());
+        for (std::size_t pos{0}; pos != v.size();)
+            code_points.push_back(next_folded_code_point(v, pos));
+
+        length_ = code_points.size();
+        word_count_ = std::max<std::size_t>(1, (length_ + 63) / 64);
+
+        for (uint32_t c : code_points) {
+            if (c > 0xFF)
+                others_.push_back(c);
+        }
+        std::sort(others_.begin(), others_.end());
+        others_.erase(std::unique(others_.begin(), others_.end()), others_.end());
+
+        latin1_.assign(256 * word_count_, 0);
+        other_masks_.assign(others_.size() * word_count_, 0);
+        zeros_.assign(word_count_, 0);
+        for (std::size_t i{0}; i != length_; ++i) {
+            uint32_t c = code_points[i];
+            uint64_t* masks = c <= 0xFF ? &latin1_[c * word_count_] : &other_masks_[other_index(c) * word_count_];
+            masks[i / 64] |= uint64_t{1} << (i % 64);
+        }
+    }
+
+    const uint64_t* get(uint32_t c) const noexcept
+    {
+        if (c <= 0xFF)
+            return &latin1_[c * word_count_];
+
+        auto found = std::lower_bound(others_.begin(), others_.end(), c);
+        if (found == others_.end() || *found != c)
+            return zeros_.data();
+
+        return &other_masks_[static_cast<std::size_t>(found - others_.begin()) * word_count_];
+    }
+
+    /**
+     * The masks of code points which aren't in the pattern.
+     */
+    const uint64_t* zeros() const noexcept
+    {
+        return zeros_.data();
+    }
+
+    std::size_t length() const noexcept
+    {
+        return length_;
+    }
+
+    std::size_t word_count() const noexcept
+    {
+        return word_count_;
+    }
+
+private:
+
+    std::size_t other_index(uint32_t c) const noexcept
+    {
+        return static_cast<std::size_t>(std::lower_bound(others_.begin(), others_.end(), c) - others_.begin());
+    }
+
+    std::size_t length_{0};
+    std::size_t word_count_{0};
+    std::vector<uint64_t> latin1_;
+    std::vector<uint32_t> others_;
+    std::vector<uint64_t> other_masks_;
+    std::vector<uint64_t> zeros_;
+};
+
+
+/**
+ * The distance can't drop below score minus the code points left in the text, which are at most its bytes.
+ */
+bool exceeds_bound(std::size_t score, std::size_t remaining_bytes, std::size_t max_distance) noexcept
+{
+    return score > remaining_bytes && score - remaining_bytes > max_distance;
+}
+
+
+/**
+ * Can the length difference alone rule out max_distance for a pattern of m code points? The text has at most a
+ * code point per byte and at least one per byte which isn't a continuation byte, as every such byte starts one.
+ */
+bool exceeds_length_bound(std::size_t m, std::string_view text, std::size_t max_distance) noexcept
+{
+    if (max_distance == std::string_view::npos)
+        return false;
+
+    if (m > text.size() && m - text.size() > max_distance)
+        return true;
+
+    const auto& kernels = u8_simd::kernels();
+    std::size_t begin_count = text.size() - kernels.count_bytes_at_least(text.data(), text.size(), 0x80) + kernels.count_bytes_at_least(text.data(), text.size(), 0xC0);
+    return begin_count > m && begin_count - m > max_distance;
+}
+
+
+std::size_t bounded(std::size_t distance, std::size_t max_distance) noexcept
+{
+    return distance <= max_distance ? distance : std::string_view::npos;
+}
+
+
+/**
+ * Hyyrö's formulation of Myers' bit-parallel algorithm for a pattern of 1 to 64 code points.
+ *
+ * The column of the DP matrix for the current text position is kept as vertical deltas, bit i of vp (vn) is set if
+ * row i + 1 is one more (less) than row i. A text code point updates the whole column with a few word operations,
+ * the last row is the distance of the pattern to the text so far. Damerau adds the transpositions of optimal
+ * string alignment as in Hyyrö 2003: a match of the previous pattern code point here and of this one in the
+ * previous column is another diagonal zero.
+ */
+template<bool damerau, class Masks>
+std::size_t word_distance(const Masks& masks, std::string_view text, std::size_t max_distance) noexcept
+{
+    std::size_t m = masks.length();
+    uint64_t last = uint64_t{1} << (m - 1);
+    uint64_t vp = ~uint64_t{0} >> (64 - m);
+    uint64_t vn{0};
+    uint64_t d0{0};
+    uint64_t previous_eq{0};
+    std::size_t score = m;
+
+    for (std::size_t pos{0}; pos != text.size();) {
+        if (exceeds_bound(score, text.size() - pos, max_distance))
+            return std::string_view::npos;
+
+        uint64_t eq = *masks.get(next_folded_code_point(text, pos));
+        uint64_t transpositions{0};
+        if (damerau) {
+            transpositions = ((~d0 & eq) << 1) & previous_eq;
+            previous_eq = eq;
+        }
+
+        d0 = (((eq & vp) + vp) ^ vp) | eq | vn | transpositions;
+        uint64_t hp = vn | ~(d0 | vp);
+        uint64_t hn = d0 & vp;
+        score += (hp & last) != 0;
+        score -= (hn & last) != 0;
+
+        hp = (hp << 1) | 1;
+        hn <<= 1;
+        vp = hn | ~(d0 | hp);
+        vn = hp & d0;
+    }
+
+    return bounded(score, max_distance);
+}
+
+
+/**
+ * word_distance for longer patterns, a column is a word per 64 pattern code points. The horizontal delta entering
+ * the first row of a word and the carry of the addition come from the previous word, so the words go in order.
+ */
+template<bool damerau>
+std::size_t block_distance(const Block_masks& masks, std::string_view text, std::size_t max_distance)
+{
+    std::size_t m = masks.length();
+    std::size_t word_count = masks.word_count();
+    uint64_t last = uint64_t{1} << ((m - 1) % 64);
+
+    // vp, vn and d0 of every word, on the stack for patterns of up to 512 code points
+    constexpr std::size_t stack_word_count = 8;
+    std::array<uint64_t, 3 * stack_word_count> stack_state{};
+    std::vector<uint64_t> heap_state;
+    uint64_t* vp = stack_state.data();
+    if (word_count > stack_word_count) {
+        heap_state.assign(3 * word_count, 0);
+        vp = heap_state.data();
+    }
+    uint64_t* vn = vp + word_count;
+    uint64_t* d0 = vn + word_count;
+    std::fill(vp, vp + word_count, ~uint64_t{0});
+
+    const uint64_t* previous_eq = masks.zeros();
+    std::size_t score = m;
+
+    for (std::size_t pos{0}; pos != text.size();) {
+        if (exceeds_bound(score, text.size() - pos, max_distance))
+            return std::string_view::npos;
+
+        const uint64_t* eq = masks.get(next_folded_code_point(text, pos));
+        uint64_t hp_carry{1};
+        uint64_t hn_carry{0};
+        uint64_t transposition_carry{0};
+
+        for (std::size_t w{0}; w != word_count; ++w) {
+            uint64_t transpositions{0};
+            if (damerau) {
+                uint64_t matches = ~d0[w] & eq[w];
+                transpositions = ((matches << 1) | transposition_carry) & previous_eq[w];
+                transposition_carry = matches >> 63;
+            }
+
+            uint64_t x = eq[w] | hn_carry;
+            uint64_t d = (((x & vp[w]) + vp[w]) ^ vp[w]) | x | vn[w] | transpositions;
+            uint64_t hp = vn[w] | ~(d | vp[w]);
+            uint64_t hn = d & vp[w];
+            if (w + 1 == word_count) {
+                score += (hp & last) != 0;
+                score -= (hn & last) != 0;
+            }
+
+            uint64_t next_hp_carry = hp >> 63;
+            uint64_t next_hn_carry = hn >> 63;
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = next_hp_carry;
+            hn_carry = next_hn_carry;
+
+            vp[w] = hn | ~(d | hp);
+            vn[w] = hp & d;
+            d0[w] = d;
+        }
+
+        previous_eq = eq;
+    }
+
+    return bounded(score, max_distance);
+}
+
+
+template<class Masks>
+std::size_t word_distance(const Masks& masks, std::string_view text, std::size_t max_distance, Edit_distance metric) noexcept
+{
+    if (exceeds_length_bound(masks.length(), text, max_distance))
+        return std::string_view::npos;
+
+    if (masks.length() == 0)
+        return bounded(folded_length(text), max_distance);
+
+    if (metric == Edit_distance::damerau)
+        return word_distance<true>(masks, text, max_distance);
+
+    return word_distance<false>(masks, text, max_distance);
+}
+
+
+std::size_t block_distance(const Block_masks& masks, std::string_view text, std::size_t max_distance, Edit_distance metric)
+{
+    if (exceeds_length_bound(masks.length(), text, max_distance))
+        return std::string_view::npos;
+
+    if (metric == Edit_distance::damerau)
+        return block_distance<true>(masks, text, max_distance);
+
+    return block_distance<false>(masks, text, max_distance);
+}
+
+}
+
+
+
+struct Fuzzy_pattern::Compiled {
+
+    Compiled(std::string_view pattern, Edit_distance metric): masks{pattern}, metric{metric}
+    {
+    }
+
+    Block_masks masks;
+    Edit_distance metric;
+};
+
+
+Fuzzy_pattern::Fuzzy_pattern(Utf8_view pattern, Edit_distance metric):
+    compiled_{std::make_shared<const Compiled>(pattern.v_, metric)}
+{
+}
+
+
+std::size_t Fuzzy_pattern::distance(Utf8_view text, std::size_t max_distance) const
+{
+    const Block_masks& masks = compiled_->masks;
+    if (masks.length() <= 64)
+        return word_distance(masks, text.v_, max_distance, compiled_->metric);
+
+    return block_distance(masks, text.v_, max_distance, compiled_->metric);
+}
+
+
+std::size_t Fuzzy_pattern::code_point_count() const noexcept
+{
+    return compiled_->masks.length();
+}
+
+
+
+std::size_t u8_iedit_distance(Utf8_view v1, Utf8_view v2, std::size_t max_distance, Edit_distance metric)
+{
+    if (v1.v_ == v2.v_)
+        return 0;
+
+    // The distance is symmetric, either string may be the pattern
+    Word_masks& masks = thread_word_masks;
+    if (masks.assign(v1.v_))
+        return word_distance(masks, v2.v_, max_distance, metric);
+
+    if (masks.assign(v2.v_))
+        return word_distance(masks, v1.v_, max_distance, metric);
+
+    if (v1.v_.size() > v2.v_.size())
+        std::swap(v1, v2);
+
+    return block_distance(Block_masks{v1.v_}, v2.v_, max_distance, metric);
+}
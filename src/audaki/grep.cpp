@@ -0,0 +1,248 @@
+#include "audaki/u8string.h"
+
+#include "audaki/decoder.h"
+#include "audaki/icase_search.h"
+#include "audaki/simd_kernels.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+namespace {
+
+/**
+ * Matches of one chunk, line numbers are the line breaks before the line within the chunk.
+ */
+struct Chunk_result {
+    std::vector<Icase_line_match> matches;
+    std::size_t line_break_count{0};
+};
+
+
+/**
+ * Every line matches the empty needle at its beginning, a final line break doesn't start another line.
+ */
+void grep_chunk_all_lines(std::string_view chunk, Chunk_result& result)
+{
+    for (std::size_t line_begin{0}; line_begin < chunk.size(); ++result.line_break_count) {
+        result.matches.push_back({result.line_break_count, line_begin, line_begin, line_begin});
+
+        std::size_t line_end = chunk.find('\n', line_begin);
+        if (line_end == std::string_view::npos)
+            return;
+
+        line_begin = line_end + 1;
+    }
+}
+
+
+/**
+ * The first match of each line in one pass over the chunk, so every byte is folded once.
+ */
+void grep_chunk(std::string_view chunk, const u8_search::Searcher& searcher, Chunk_result& result)
+{
+    std::size_t line_breaks{0};
+    std::size_t counted{0};
+    std::size_t next_line_begin{0};
+
+    u8_search::for_each_folded_match<u8_decoder::Checked>(chunk, searcher, [&](std::size_t begin, std::size_t end) {
+        if (begin < next_line_begin)
+            return true;
+
+        std::size_t line_break = begin ? chunk.rfind('\n', begin - 1) : std::string_view::npos;
+        std::size_t line_begin = line_break == std::string_view::npos ? 0 : line_break + 1;
+        line_breaks += u8_simd::kernels().count_byte(chunk.data() + counted, line_begin - counted, '\n');
+        counted = line_begin;
+        result.matches.push_back({line_breaks, line_begin, begin, end});
+
+        std::size_t line_end = chunk.find('\n', end);
+        next_line_begin = line_end == std::string_view::npos ? chunk.size() : line_end + 1;
+        return line_end != std::string_view::npos;
+    });
+
+    result.line_break_count = line_breaks + u8_simd::kernels().count_byte(chunk.data() + counted, chunk.size() - counted, '\n');
+}
+
+
+/**
+ * Searches windows of the text one after the other, each split into chunks at line breaks for the threads of
+ * the shared pool.
+ */
+class Grep {
+public:
+
+    Grep(const Icase_pattern& pattern, Execution execution):
+        folded_needle_{pattern.folded_needle()},
+        searcher_{folded_needle_.empty() ? std::string_view{" "} : folded_needle_},
+        thread_count_{execution == Execution::parallel ? Thread_pool::shared().thread_count() : 1}
+    {
+    }
+
+    /**
+     * Search the window at offset, it has to begin at a line start and follow the previous one.
+     */
+    void search(std::string_view window, std::size_t offset)
+    {
+        std::size_t chunk_count = std::min(thread_count_, window.size() / min_chunk_size + 1);
+        std::vector<std::size_t> bounds{0};
+        for (std::size_t i{1}; i != chunk_count; ++i) {
+            std::size_t line_end = window.find('\n', std::max(bounds.back(), window.size() / chunk_count * i));
+            if (line_end == std::string_view::npos)
+                break;
+            bounds.push_back(line_end + 1);
+        }
+        bounds.push_back(window.size());
+
+        std::vector<Chunk_result> results(bounds.size() - 1);
+        auto search_chunk = [&](std::size_t i) {
+            std::string_view chunk = window.substr(bounds[i], bounds[i + 1] - bounds[i]);
+            // Needles with line breaks only match across lines, so no line contains them
+            if (folded_needle_.empty())
+                grep_chunk_all_lines(chunk, results[i]);
+            else if (folded_needle_.find('\n') == std::string_view::npos)
+                grep_chunk(chunk, searcher_, results[i]);
+            else
+                results[i].line_break_count = u8_simd::kernels().count_byte(chunk.data(), chunk.size(), '\n');
+        };
+
+        if (results.size() == 1)
+            search_chunk(0);
+        else
+            Thread_pool::shared().run(results.size(), search_chunk);
+
+        for (std::size_t i{0}; i != results.size(); ++i) {
+            std::size_t chunk_offset = offset + bounds[i];
+            for (const auto& match : results[i].matches) {
+                matches_.push_back({
+                    line_breaks_ + match.line_number + 1,
+                    chunk_offset + match.line_begin,
+                    chunk_offset + match.match_begin,
+                    chunk_offset + match.match_end});
+            }
+
+            line_breaks_ += results[i].line_break_count;
+        }
+    }
+
+    std::vector<Icase_line_match> take_matches() noexcept
+    {
+        return std::move(matches_);
+    }
+
+private:
+
+    static constexpr std::size_t min_chunk_size = std::size_t{1} << 20;
+
+    std::string_view folded_needle_;
+    u8_search::Searcher searcher_;
+    std::size_t thread_count_;
+    std::size_t line_breaks_{0};
+    std::vector<Icase_line_match> matches_;
+};
+
+
+class File_mapping {
+public:
+
+    explicit File_mapping(const char* path) noexcept
+    {
+        fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+            return;
+
+        struct stat status;
+        if (::fstat(fd_, &status) != 0 || !S_ISREG(status.st_mode))
+            return;
+
+        size_ = static_cast<std::size_t>(status.st_size);
+        if (size_ == 0) {
+            is_ok_ = true;
+            return;
+        }
+
+        void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED)
+            return;
+
+        data_ = static_cast<const char*>(data);
+        ::madvise(data, size_, MADV_SEQUENTIAL);
+        is_ok_ = true;
+    }
+
+    ~File_mapping()
+    {
+        if (data_)
+            ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    File_mapping(const File_mapping&) = delete;
+    File_mapping& operator=(const File_mapping&) = delete;
+
+    bool is_ok() const noexcept
+    {
+        return is_ok_;
+    }
+
+    std::string_view view() const noexcept
+    {
+        return {data_, size_};
+    }
+
+    /**
+     * Drop the pages of [0, end) from the mapping, the file stays in the page cache for other readers.
+     */
+    void release(std::size_t end) const noexcept
+    {
+        auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        std::size_t released = end / page_size * page_size;
+        if (released)
+            ::madvise(const_cast<char*>(data_), released, MADV_DONTNEED);
+    }
+
+private:
+
+    int fd_{-1};
+    const char* data_{nullptr};
+    std::size_t size_{0};
+    bool is_ok_{false};
+};
+
+}
+
+
+
+std::vector<Icase_line_match> icase_grep(Utf8_view text, const Icase_pattern& pattern, Execution execution)
+{
+    Grep grep{pattern, execution};
+    grep.search(text.v_, 0);
+    return grep.take_matches();
+}
+
+
+std::optional<std::vector<Icase_line_match>> icase_grep_file(const char* path, const Icase_pattern& pattern, Execution execution, std::size_t window_size)
+{
+    File_mapping file{path};
+    if (!file.is_ok())
+        return std::nullopt;
+
+    std::string_view text = file.view();
+    Grep grep{pattern, execution};
+    for (std::size_t begin{0}; begin != text.size();) {
+        std::size_t end = std::min(text.size(), begin + std::max(window_size, std::size_t{1}));
+        if (end != text.size()) {
+            std::size_t line_end = text.find('\n', end - 1);
+            end = line_end == std::string_view::npos ? text.size() : line_end + 1;
+        }
+
+        grep.search(text.substr(begin, end - begin), begin);
+        file.release(end);
+        begin = end;
+    }
+
+    return grep.take_matches();
+}
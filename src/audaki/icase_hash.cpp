@@ -0,0 +1,151 @@
+#include "audaki/u8string.h"
+
+#include "audaki/decoder.h"
+#include "audaki/icase_search.h"
+
+
+
+namespace {
+
+/**
+ * Streaming xxHash64 (Yann Collet), the input may arrive in pieces of any size.
+ *
+ * Long input is consumed in 32 byte stripes by four independent lanes, the rest and short input go through
+ * the final mix, which avalanches every input bit into the whole result.
+ */
+class Hash64 {
+public:
+
+    void update(const char* p, std::size_t n) noexcept
+    {
+        length_ += n;
+
+        if (buffered_) {
+            std::size_t take = std::min(n, stripe_size - buffered_);
+            std::memcpy(buffer_.data() + buffered_, p, take);
+            buffered_ += take;
+            p += take;
+            n -= take;
+            if (buffered_ != stripe_size)
+                return;
+
+            consume_stripe(buffer_.data());
+            buffered_ = 0;
+        }
+
+        for (; n >= stripe_size; p += stripe_size, n -= stripe_size)
+            consume_stripe(p);
+
+        std::memcpy(buffer_.data(), p, n);
+        buffered_ = n;
+    }
+
+    uint64_t finish() const noexcept
+    {
+        uint64_t h;
+        if (length_ >= stripe_size) {
+            h = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12) + rotl(lanes_[3], 18);
+            for (uint64_t lane : lanes_)
+                h = (h ^ round(0, lane)) * prime_1 + prime_4;
+        }
+        else {
+            h = prime_5;
+        }
+
+        h += length_;
+
+        const char* p = buffer_.data();
+        std::size_t n = buffered_;
+        for (; n >= 8; p += 8, n -= 8)
+            h = rotl(h ^ round(0, read<uint64_t>(p)), 27) * prime_1 + prime_4;
+
+        if (n >= 4) {
+            h = rotl(h ^ (read<uint32_t>(p) * prime_1), 23) * prime_2 + prime_3;
+            p += 4;
+            n -= 4;
+        }
+
+        for (; n; ++p, --n)
+            h = rotl(h ^ (static_cast<uint8_t>(*p) * prime_5), 11) * prime_1;
+
+        h ^= h >> 33;
+        h *= prime_2;
+        h ^= h >> 29;
+        h *= prime_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+
+    static constexpr uint64_t prime_1 = 0x9E37'79B1'85EB'CA87u;
+    static constexpr uint64_t prime_2 = 0xC2B2'AE3D'27D4'EB4Fu;
+    static constexpr uint64_t prime_3 = 0x1656'67B1'9E37'79F9u;
+    static constexpr uint64_t prime_4 = 0x85EB'CA77'C2B2'AE63u;
+    static constexpr uint64_t prime_5 = 0x27D4'EB2F'1656'67C5u;
+    static constexpr std::size_t stripe_size = 32;
+
+    static uint64_t rotl(uint64_t x, int r) noexcept
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t input) noexcept
+    {
+        return rotl(lane + input * prime_2, 31) * prime_1;
+    }
+
+    template<class T>
+    static T read(const char* p) noexcept
+    {
+        T v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void consume_stripe(const char* p) noexcept
+    {
+        for (std::size_t i{0}; i != 4; ++i)
+            lanes_[i] = round(lanes_[i], read<uint64_t>(p + 8 * i));
+    }
+
+    std::array<uint64_t, 4> lanes_{prime_1 + prime_2, prime_2, 0, 0 - prime_1};
+    std::array<char, stripe_size> buffer_;
+    std::size_t buffered_{0};
+    std::size_t length_{0};
+};
+
+
+/**
+ * Hash of the folded bytes, folded on the stack chunk by chunk.
+ */
+template<class Decoder>
+uint64_t ihash(std::string_view v) noexcept
+{
+    std::array<char, 256> folded;
+    Hash64 hash;
+
+    std::size_t pos{0};
+    while (pos != v.size()) {
+        auto result = u8_search::fold_chunk<Decoder>(v.data() + pos, v.size() - pos, folded.data(), folded.size());
+        hash.update(folded.data(), result.produced);
+        pos += result.consumed;
+    }
+
+    return hash.finish();
+}
+
+}
+
+
+
+uint64_t u8_ihash(Utf8_view v) noexcept
+{
+    return ihash<u8_decoder::Checked>(v.v_);
+}
+
+
+uint64_t u8_ihash(Validated_utf8_view v) noexcept
+{
+    return ihash<u8_decoder::Unchecked>(v.string_view());
+}
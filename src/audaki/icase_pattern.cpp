@@ -0,0 +1,116 @@
+#include "audaki/u8string.h"
+
+#include "audaki/decoder.h"
+#include "audaki/icase_search.h"
+
+
+
+struct Icase_pattern::Compiled {
+
+    explicit Compiled(std::string folded): folded{std::move(folded)}, searcher{this->folded.empty() ? std::string_view{" "} : std::string_view{this->folded}}
+    {
+    }
+
+    template<class Decoder>
+    bool contains(std::string_view haystack) const noexcept
+    {
+        if (folded.empty())
+            return true;
+
+        // A single folded byte is an ASCII character, and only ASCII bytes fold to ASCII
+        if (folded.size() == 1)
+            return u8_simd::kernels().find_ascii_ibyte(haystack.data(), haystack.size(), folded[0]) != haystack.size();
+
+        return u8_search::contains_folded<Decoder>(haystack, searcher);
+    }
+
+    template<class Decoder>
+    std::optional<Icase_match> find(std::string_view haystack) const noexcept
+    {
+        if (folded.empty())
+            return Icase_match{0, 0};
+
+        std::optional<Icase_match> match;
+        u8_search::for_each_folded_match<Decoder>(haystack, searcher, [&](std::size_t begin, std::size_t end) {
+            match = Icase_match{begin, end};
+            return false;
+        });
+
+        return match;
+    }
+
+    template<class Decoder>
+    std::vector<Icase_match> find_all(std::string_view haystack) const
+    {
+        if (folded.empty())
+            return {Icase_match{0, 0}};
+
+        std::vector<Icase_match> matches;
+        u8_search::for_each_folded_match<Decoder>(haystack, searcher, [&](std::size_t begin, std::size_t end) {
+            matches.push_back({begin, end});
+            return true;
+        });
+
+        return matches;
+    }
+
+    std::string folded;
+
+    // Refers to folded, so Compiled is never copied or moved
+    u8_search::Searcher searcher;
+};
+
+
+
+Icase_pattern::Icase_pattern(Utf8_view needle):
+    compiled_{std::make_shared<const Compiled>(u8_search::fold<u8_decoder::Checked>(needle.v_))}
+{
+}
+
+
+Icase_pattern::Icase_pattern(Validated_utf8_view needle):
+    compiled_{std::make_shared<const Compiled>(u8_search::fold<u8_decoder::Unchecked>(needle.string_view()))}
+{
+}
+
+
+bool Icase_pattern::contains(Utf8_view haystack) const noexcept
+{
+    return compiled_->contains<u8_decoder::Checked>(haystack.v_);
+}
+
+
+bool Icase_pattern::contains(Validated_utf8_view haystack) const noexcept
+{
+    return compiled_->contains<u8_decoder::Unchecked>(haystack.string_view());
+}
+
+
+std::optional<Icase_match> Icase_pattern::find(Utf8_view haystack) const noexcept
+{
+    return compiled_->find<u8_decoder::Checked>(haystack.v_);
+}
+
+
+std::optional<Icase_match> Icase_pattern::find(Validated_utf8_view haystack) const noexcept
+{
+    return compiled_->find<u8_decoder::Unchecked>(haystack.string_view());
+}
+
+
+std::vector<Icase_match> Icase_pattern::find_all(Utf8_view haystack) const
+{
+    return compiled_->find_all<u8_decoder::Checked>(haystack.v_);
+}
+
+
+std::vector<Icase_match> Icase_pattern::find_all(Validated_utf8_view haystack) const
+{
+    return compiled_->find_all<u8_decoder::Unchecked>(haystack.string_view());
+}
+
+
+std::string_view Icase_pattern::folded_needle() const noexcept
+{
+    return compiled_->folded;
+}
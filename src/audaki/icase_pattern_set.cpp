@@ -0,0 +1,421 @@
+#include "audaki/u8string.h"
+
+#include "audaki/decoder.h"
+#include "audaki/icase_search.h"
+#include "audaki/simd_kernels.h"
+
+#include <deque>
+#include <limits>
+
+
+
+/*
+ * Aho-Corasick automaton over the folded pattern bytes (Aho, Corasick, "Efficient string matching").
+ *
+ * The failure links are resolved at build time, so every state has a transition for every byte and matching
+ * is a single table lookup per folded byte. Bytes which occur in no pattern all lead back to the root and share
+ * one byte class, which keeps the rows of the transition table short.
+ *
+ * The haystack is folded code point by code point while it is matched. While in the root state, runs of ASCII
+ * bytes which can't start any pattern are skipped with a vector scan.
+ */
+struct Icase_pattern_set::Compiled {
+
+    static constexpr uint32_t no_state = std::numeric_limits<uint32_t>::max();
+
+
+    explicit Compiled(const std::vector<std::string_view>& patterns)
+    {
+        std::vector<std::string> folded;
+        folded.reserve(patterns.size());
+        for (auto pattern : patterns)
+            folded.push_back(u8_search::fold<u8_decoder::Checked>(pattern));
+
+        pattern_count = folded.size();
+        pattern_sizes.reserve(folded.size());
+        for (const auto& pattern : folded) {
+            pattern_sizes.push_back(pattern.size());
+            max_pattern_size = std::max(max_pattern_size, pattern.size());
+        }
+
+        prepare_byte_classes(folded);
+        build_trie(folded);
+        build_failure_links();
+        prepare_start_bytes(folded);
+    }
+
+
+    void prepare_byte_classes(const std::vector<std::string>& folded)
+    {
+        byte_class.fill(0);
+        for (const auto& pattern : folded) {
+            for (char c : pattern)
+                byte_class[static_cast<uint8_t>(c)] = 1;
+        }
+
+        class_count = 1;
+        for (auto& c : byte_class) {
+            if (c)
+                c = static_cast<uint8_t>(class_count++);
+        }
+    }
+
+
+    uint32_t add_state()
+    {
+        transitions.resize(transitions.size() + class_count, no_state);
+        output_begin.push_back(0);
+        output_link.push_back(no_state);
+        return static_cast<uint32_t>(output_begin.size() - 1);
+    }
+
+
+    void build_trie(const std::vector<std::string>& folded)
+    {
+        add_state();
+
+        // Collect the patterns ending in every state, then store them as one flat array
+        std::vector<std::vector<uint32_t>> state_patterns(1);
+        for (std::size_t i{0}; i != folded.size(); ++i) {
+            if (folded[i].empty()) {
+                empty_patterns.push_back(static_cast<uint32_t>(i));
+                continue;
+            }
+
+            uint32_t state{0};
+            for (char c : folded[i]) {
+                uint32_t& next = transitions[state * class_count + byte_class[static_cast<uint8_t>(c)]];
+                if (next == no_state) {
+                    uint32_t added = add_state();
+                    state_patterns.emplace_back();
+                    transitions[state * class_count + byte_class[static_cast<uint8_t>(c)]] = added;
+                }
+
+                state = transitions[state * class_count + byte_class[static_cast<uint8_t>(c)]];
+            }
+
+            state_patterns[state].push_back(static_cast<uint32_t>(i));
+        }
+
+        output_begin.push_back(0);
+        for (std::size_t state{0}; state != state_patterns.size(); ++state) {
+            output_begin[state] = static_cast<uint32_t>(outputs.size());
+            outputs.insert(outputs.end(), state_patterns[state].begin(), state_patterns[state].end());
+        }
+        output_begin.back() = static_cast<uint32_t>(outputs.size());
+    }
+
+
+    bool has_own_output(uint32_t state) const noexcept
+    {
+        return output_begin[state] != output_begin[state + 1];
+    }
+
+
+    void build_failure_links()
+    {
+        std::size_t state_count = output_link.size();
+        std::vector<uint32_t> failure(state_count, 0);
+        std::deque<uint32_t> queue;
+
+        for (std::size_t c{0}; c != class_count; ++c) {
+            uint32_t& next = transitions[c];
+            if (next == no_state)
+                next = 0;
+            else
+                queue.push_back(next);
+        }
+
+        // Breadth first, so the failure state of every state is complete before the state itself
+        while (!queue.empty()) {
+            uint32_t state = queue.front();
+            queue.pop_front();
+
+            uint32_t fail = failure[state];
+            output_link[state] = has_own_output(fail) ? fail : output_link[fail];
+
+            for (std::size_t c{0}; c != class_count; ++c) {
+                uint32_t& next = transitions[state * class_count + c];
+                if (next == no_state) {
+                    next = transitions[fail * class_count + c];
+                }
+                else {
+                    failure[next] = transitions[fail * class_count + c];
+                    queue.push_back(next);
+                }
+            }
+        }
+
+        is_match.resize(state_count);
+        for (std::size_t state{0}; state != state_count; ++state)
+            is_match[state] = has_own_output(static_cast<uint32_t>(state)) || output_link[state] != no_state;
+    }
+
+
+    void prepare_start_bytes(const std::vector<std::string>& folded)
+    {
+        // Non-ASCII bytes always stop the skip, so only the ASCII first bytes need to be collected
+        std::array<bool, 128> is_start{};
+        for (const auto& pattern : folded) {
+            if (!pattern.empty() && static_cast<uint8_t>(pattern[0]) < 0x80)
+                is_start[static_cast<uint8_t>(pattern[0])] = true;
+        }
+
+        start_byte_count = 0;
+        for (std::size_t c{0}; c != is_start.size(); ++c) {
+            if (!is_start[c])
+                continue;
+
+            if (start_byte_count == start_bytes.size()) {
+                skip_root = false;
+                return;
+            }
+
+            start_bytes[start_byte_count++] = static_cast<char>(c);
+        }
+
+        skip_root = true;
+    }
+
+
+    uint32_t step(uint32_t state, char c) const noexcept
+    {
+        return transitions[state * class_count + byte_class[static_cast<uint8_t>(c)]];
+    }
+
+
+    /**
+     * Call on_match(pattern, begin, end) for every match until it returns false. Returns false if it stopped early.
+     * Without track_begins, begin is always 0.
+     *
+     * Matches start and end on code point boundaries, because the folded patterns and the folded haystack are
+     * well-formed. To find the begin of a match, the original offset of every code point is recorded in a ring
+     * indexed by its folded offset, which is large enough to look back by the longest pattern.
+     */
+    template<class Decoder, bool track_begins, class On_match>
+    bool match(std::string_view haystack, On_match on_match) const
+    {
+        const char* h = haystack.data();
+        std::size_t n = haystack.size();
+        std::size_t pos{0};
+        std::size_t folded_pos{0};
+        uint32_t state{0};
+
+        std::vector<std::size_t> begins;
+        std::size_t ring_mask{0};
+        if constexpr (track_begins) {
+            std::size_t ring_size{1};
+            while (ring_size <= max_pattern_size)
+                ring_size *= 2;
+
+            begins.resize(ring_size);
+            ring_mask = ring_size - 1;
+        }
+
+        auto find_start_bytes = u8_simd::kernels().find_ascii_ibytes_or_non_ascii;
+        while (pos != n) {
+            if (state == 0 && skip_root) {
+                std::size_t skip = find_start_bytes(h + pos, n - pos, start_bytes.data(), start_byte_count);
+                pos += skip;
+                folded_pos += skip;
+                if (pos == n)
+                    break;
+            }
+
+            if constexpr (track_begins)
+                begins[folded_pos & ring_mask] = pos;
+
+            if (static_cast<uint8_t>(h[pos]) < 0x80) {
+                state = step(state, u8_simd::ascii_to_lower(h[pos]));
+                ++pos;
+                ++folded_pos;
+            }
+            else if (u8_decoder::is_c3_sequence(h + pos, n - pos)) {
+                state = step(step(state, h[pos]), u8_decoder::lower_c3(h[pos + 1]));
+                pos += 2;
+                folded_pos += 2;
+            }
+            else {
+                auto decoded = Decoder::decode(h + pos, n - pos);
+                char folded[4];
+                std::size_t folded_size = u8_search::encode_utf8(decoded.code_point.as_lower_case(), folded);
+                for (std::size_t i{0}; i != folded_size; ++i)
+                    state = step(state, folded[i]);
+
+                pos += decoded.byte_count;
+                folded_pos += folded_size;
+            }
+
+            if (!is_match[state])
+                continue;
+
+            for (uint32_t s = state; s != no_state; s = output_link[s]) {
+                for (uint32_t i = output_begin[s]; i != output_begin[s + 1]; ++i) {
+                    uint32_t pattern = outputs[i];
+                    std::size_t begin = track_begins ? begins[(folded_pos - pattern_sizes[pattern]) & ring_mask] : 0;
+                    if (!on_match(pattern, begin, pos))
+                        return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+
+    template<class Decoder>
+    bool contains_any(std::string_view haystack) const noexcept
+    {
+        if (!empty_patterns.empty())
+            return true;
+
+        return !match<Decoder, false>(haystack, [](uint32_t, std::size_t, std::size_t) {
+            return false;
+        });
+    }
+
+
+    template<class Decoder>
+    std::vector<std::size_t> matched_patterns(std::string_view haystack) const
+    {
+        std::vector<bool> is_matched(pattern_count);
+        std::size_t matched_count{0};
+        for (auto pattern : empty_patterns) {
+            is_matched[pattern] = true;
+            ++matched_count;
+        }
+
+        // Stop as soon as every pattern was seen
+        if (matched_count != pattern_count) {
+            match<Decoder, false>(haystack, [&](uint32_t pattern, std::size_t, std::size_t) {
+                if (!is_matched[pattern]) {
+                    is_matched[pattern] = true;
+                    ++matched_count;
+                }
+
+                return matched_count != pattern_count;
+            });
+        }
+
+        std::vector<std::size_t> patterns;
+        patterns.reserve(matched_count);
+        for (std::size_t i{0}; i != pattern_count; ++i) {
+            if (is_matched[i])
+                patterns.push_back(i);
+        }
+
+        return patterns;
+    }
+
+
+    template<class Decoder>
+    std::vector<Icase_set_match> find_all(std::string_view haystack) const
+    {
+        std::vector<Icase_set_match> matches;
+        for (auto pattern : empty_patterns)
+            matches.push_back({pattern, 0, 0});
+
+        match<Decoder, true>(haystack, [&](uint32_t pattern, std::size_t begin, std::size_t end) {
+            matches.push_back({pattern, begin, end});
+            return true;
+        });
+
+        return matches;
+    }
+
+
+    std::array<uint8_t, 256> byte_class;
+    std::size_t class_count{0};
+
+    // class_count entries per state
+    std::vector<uint32_t> transitions;
+
+    // Patterns ending in a state are outputs[output_begin[state], output_begin[state + 1]), further matches
+    // ending there are found by following output_link to the longest suffix state with outputs
+    std::vector<uint32_t> output_begin;
+    std::vector<uint32_t> outputs;
+    std::vector<uint32_t> output_link;
+    std::vector<bool> is_match;
+
+    std::vector<uint32_t> empty_patterns;
+    std::vector<std::size_t> pattern_sizes;
+    std::size_t pattern_count{0};
+    std::size_t max_pattern_size{0};
+
+    std::array<char, u8_simd::max_ibyte_set_size> start_bytes;
+    std::size_t start_byte_count{0};
+    bool skip_root{false};
+};
+
+
+
+namespace {
+
+std::vector<std::string_view> as_string_views(const std::vector<std::string>& strings)
+{
+    return {strings.begin(), strings.end()};
+}
+
+}
+
+
+
+Icase_pattern_set::Icase_pattern_set(const std::vector<std::string>& patterns):
+    compiled_{std::make_shared<const Compiled>(as_string_views(patterns))}
+{
+}
+
+
+Icase_pattern_set::Icase_pattern_set(const std::vector<std::string_view>& patterns):
+    compiled_{std::make_shared<const Compiled>(patterns)}
+{
+}
+
+
+Icase_pattern_set::Icase_pattern_set(std::initializer_list<std::string_view> patterns):
+    compiled_{std::make_shared<const Compiled>(std::vector<std::string_view>{patterns})}
+{
+}
+
+
+std::size_t Icase_pattern_set::pattern_count() const noexcept
+{
+    return compiled_->pattern_count;
+}
+
+
+bool Icase_pattern_set::contains_any(Utf8_view haystack) const noexcept
+{
+    return compiled_->contains_any<u8_decoder::Checked>(haystack.v_);
+}
+
+
+bool Icase_pattern_set::contains_any(Validated_utf8_view haystack) const noexcept
+{
+    return compiled_->contains_any<u8_decoder::Unchecked>(haystack.string_view());
+}
+
+
+
+std::vector<std::size_t> Icase_pattern_set::matched_patterns(Utf8_view haystack) const
+{
+    return compiled_->matched_patterns<u8_decoder::Checked>(haystack.v_);
+}
+
+
+std::vector<std::size_t> Icase_pattern_set::matched_patterns(Validated_utf8_view haystack) const
+{
+    return compiled_->matched_patterns<u8_decoder::Unchecked>(haystack.string_view());
+}
+
+
+std::vector<Icase_set_match> Icase_pattern_set::find_all(Utf8_view haystack) const
+{
+    return compiled_->find_all<u8_decoder::Checked>(haystack.v_);
+}
+
+
+std::vector<Icase_set_match> Icase_pattern_set::find_all(Validated_utf8_view haystack) const
+{
+    return compiled_->find_all<u8_decoder::Unchecked>(haystack.string_view());
+}
@@ -0,0 +1,558 @@
+#pragma once
+
+#include "audaki/u8string.h"
+
+#include "audaki/decoder.h"
+#include "audaki/simd_kernels.h"
+
+#include <cstring>
+
+
+
+/**
+ * Case insensitive search on folded bytes.
+ *
+ * Folding lower cases every code point and re-encodes it, ill-formed sequences become U+FFFD. Two strings are
+ * equal according to Unicode_code_point::icompare exactly when their folded bytes are equal, so case insensitive
+ * search turns into plain byte search over the folded haystack, which is folded chunk by chunk on a stack buffer.
+ */
+namespace u8_search {
+
+
+/**
+ * Encode c to out, which needs room for 4 bytes. Returns the number of bytes written.
+ */
+inline std::size_t encode_utf8(Unicode_code_point c, char* out) noexcept
+{
+    auto utf8 = c.to_utf8();
+    std::size_t size = c.v_ == 0 ? 1 : std::char_traits<char>::length(utf8.data());
+    std::memcpy(out, utf8.data(), 4);
+    return size;
+}
+
+
+/**
+ * Number of bytes of the UTF-8 encoding of c.
+ */
+inline std::size_t utf8_byte_count(Unicode_code_point c) noexcept
+{
+    if (c.v_ <= 0x7F)
+        return 1;
+
+    if (c.v_ <= 0x7FF)
+        return 2;
+
+    if (c.v_ <= 0xFFFF)
+        return 3;
+
+    return 4;
+}
+
+
+struct Fold_result {
+    std::size_t consumed;
+    std::size_t produced;
+};
+
+
+/**
+ * Folding by lower casing, the folding of u8_iequal and icontains.
+ */
+struct Lower_folding {
+
+    /**
+     * Fold the non-ASCII code point at p to out, which needs room for 4 bytes.
+     */
+    template<class Decoder>
+    static Fold_result fold_code_point(const char* p, std::size_t n, char* out) noexcept
+    {
+        if (u8_decoder::is_c3_sequence(p, n)) {
+            out[0] = p[0];
+            out[1] = u8_decoder::lower_c3(p[1]);
+            return {2, 2};
+        }
+
+        auto decoded = Decoder::decode(p, n);
+        return {decoded.byte_count, encode_utf8(decoded.code_point.as_lower_case(), out)};
+    }
+};
+
+
+/**
+ * ASCII spelling of U+00C0 to U+00FF by their low five bits, upper and lower case letters share it. × and ÷ are
+ * empty, they aren't letters and stay as they are. The last entry is ÿ, ß at the same position is spelled ss.
+ */
+inline constexpr std::array<std::string_view, 32> accent_folded_latin1{
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "y"};
+
+
+/**
+ * Folding by lower casing and removing accents, the folding of u8_accent_iequal and accent_icontains.
+ *
+ * Letters of U+00C0 to U+00FF become their ASCII spelling (ä → a, æ → ae, þ → th) and ß and ẞ become ss. All other
+ * code points are lower cased.
+ */
+struct Accent_folding {
+
+    template<class Decoder>
+    static Fold_result fold_code_point(const char* p, std::size_t n, char* out) noexcept
+    {
+        if (u8_decoder::is_c3_sequence(p, n)) {
+            auto second = static_cast<uint8_t>(p[1]);
+            if (second == 0x9F)
+                return spell(2, "ss", out);
+
+            std::string_view spelling = accent_folded_latin1[second & 0x1F];
+            if (!spelling.empty())
+                return spell(2, spelling, out);
+
+            out[0] = p[0];
+            out[1] = u8_decoder::lower_c3(p[1]);
+            return {2, 2};
+        }
+
+        auto decoded = Decoder::decode(p, n);
+        if (decoded.code_point == Unicode_code_point{U'ẞ'})
+            return spell(decoded.byte_count, "ss", out);
+
+        return {decoded.byte_count, encode_utf8(decoded.code_point.as_lower_case(), out)};
+    }
+
+private:
+
+    static Fold_result spell(std::size_t consumed, std::string_view spelling, char* out) noexcept
+    {
+        std::memcpy(out, spelling.data(), spelling.size());
+        return {consumed, spelling.size()};
+    }
+};
+
+
+/**
+ * Fold [in, in + n) to out until either the input is consumed or less than 4 bytes of capacity remain for the
+ * next non-ASCII code point. Always stops on a code point boundary.
+ */
+template<class Decoder, class Folding = Lower_folding>
+Fold_result fold_chunk(const char* in, std::size_t n, char* out, std::size_t capacity) noexcept
+{
+    std::size_t pos{0};
+    std::size_t size{0};
+
+    while (pos != n) {
+        std::size_t run = u8_simd::kernels().ascii_to_lower_run(in + pos, std::min(n - pos, capacity - size), out + size);
+        pos += run;
+        size += run;
+
+        bool is_ascii_stop = pos != n && static_cast<uint8_t>(in[pos]) < 0x80;
+        if (pos == n || is_ascii_stop || capacity - size < 4)
+            break;
+
+        auto folded = Folding::template fold_code_point<Decoder>(in + pos, n - pos, out + size);
+        pos += folded.consumed;
+        size += folded.produced;
+    }
+
+    return {pos, size};
+}
+
+
+/**
+ * Fold the whole view.
+ */
+template<class Decoder, class Folding = Lower_folding>
+std::string fold(std::string_view v)
+{
+    std::string folded(v.size() + 4, '\0');
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != v.size()) {
+        auto result = fold_chunk<Decoder, Folding>(v.data() + pos, v.size() - pos, folded.data() + size, folded.size() - size);
+        pos += result.consumed;
+        size += result.produced;
+
+        // Only ill-formed input grows, each byte can become three
+        if (pos != v.size())
+            folded.resize(folded.size() + (v.size() - pos) * 3 + 4);
+    }
+
+    folded.resize(size);
+    return folded;
+}
+
+
+
+/**
+ * A folded needle, on the stack unless it folds to more than stack_size bytes, so searches for ordinary needles
+ * don't allocate.
+ */
+template<class Decoder, class Folding = Lower_folding>
+class Folded_needle {
+public:
+
+    static constexpr std::size_t stack_size = 256;
+
+    explicit Folded_needle(std::string_view needle)
+    {
+        auto result = fold_chunk<Decoder, Folding>(needle.data(), needle.size(), stack_buffer_.data(), stack_buffer_.size());
+        if (result.consumed == needle.size()) {
+            folded_ = {stack_buffer_.data(), result.produced};
+            return;
+        }
+
+        heap_buffer_ = fold<Decoder, Folding>(needle);
+        folded_ = heap_buffer_;
+    }
+
+    Folded_needle(const Folded_needle&) = delete;
+    Folded_needle& operator=(const Folded_needle&) = delete;
+
+    std::string_view view() const noexcept
+    {
+        return folded_;
+    }
+
+private:
+
+    std::array<char, stack_size> stack_buffer_;
+    std::string heap_buffer_;
+    std::string_view folded_;
+};
+
+
+/**
+ * Exact byte search for a non-empty needle.
+ *
+ * Short needles use the SIMD first/last byte prefilter known from fast memmem implementations: candidate
+ * positions must match the first and the last needle byte, which rarely both happen by chance. Long needles use
+ * the Two-Way algorithm (Crochemore, Perrin) with a Horspool shift table, which runs in linear time and skips
+ * ahead by up to the needle length on mismatches.
+ */
+class Searcher {
+public:
+
+    static constexpr std::size_t short_needle_limit = 32;
+
+    explicit Searcher(std::string_view needle) noexcept: needle_{needle}
+    {
+        assert(!needle.empty());
+
+        if (is_long())
+            prepare_two_way();
+    }
+
+    std::size_t needle_size() const noexcept
+    {
+        return needle_.size();
+    }
+
+    /**
+     * Offset of the first match in [h, h + n) or npos.
+     */
+    std::size_t find(const char* h, std::size_t n) const noexcept
+    {
+        if (n < needle_.size())
+            return std::string_view::npos;
+
+        if (needle_.size() == 1) {
+            const void* found = std::memchr(h, needle_[0], n);
+            return found ? static_cast<std::size_t>(static_cast<const char*>(found) - h) : std::string_view::npos;
+        }
+
+        return is_long() ? find_two_way(h, n) : find_short(h, n);
+    }
+
+private:
+
+    bool is_long() const noexcept
+    {
+        return needle_.size() > short_needle_limit;
+    }
+
+
+    std::size_t find_short(const char* h, std::size_t n) const noexcept
+    {
+        return u8_simd::kernels().find_short_needle(h, n, needle_.data(), needle_.size());
+    }
+
+
+    /**
+     * Critical factorization as in the two way implementation of musl's memmem.
+     */
+    void prepare_two_way() noexcept
+    {
+        auto n = reinterpret_cast<const unsigned char*>(needle_.data());
+        std::size_t l = needle_.size();
+
+        shift_.fill(0);
+        for (std::size_t i{0}; i != l; ++i)
+            shift_[n[i]] = i + 1;
+
+        // Maximal suffix for both orderings, the indices start at -1 on purpose and rely on unsigned wrap-around
+        auto maximal_suffix = [&](bool reversed, std::size_t& period) {
+            std::size_t ip = static_cast<std::size_t>(-1);
+            std::size_t jp{0};
+            std::size_t k{1};
+            std::size_t p{1};
+
+            while (jp + k < l) {
+                unsigned char a = n[ip + k];
+                unsigned char b = n[jp + k];
+                if (a == b) {
+                    if (k == p) {
+                        jp += p;
+                        k = 1;
+                    }
+                    else {
+                        ++k;
+                    }
+                }
+                else if (reversed ? a < b : a > b) {
+                    jp += k;
+                    k = 1;
+                    p = jp - ip;
+                }
+                else {
+                    ip = jp++;
+                    k = p = 1;
+                }
+            }
+
+            period = p;
+            return ip;
+        };
+
+        std::size_t period;
+        std::size_t reversed_period;
+        std::size_t ms = maximal_suffix(false, period);
+        std::size_t reversed_ms = maximal_suffix(true, reversed_period);
+        if (reversed_ms + 1 > ms + 1) {
+            ms = reversed_ms;
+            period = reversed_period;
+        }
+
+        critical_position_ = ms;
+        if (std::memcmp(n, n + period, ms + 1) != 0) {
+            memory_after_period_ = 0;
+            period_ = std::max(ms, l - ms - 1) + 1;
+        }
+        else {
+            memory_after_period_ = l - period;
+            period_ = period;
+        }
+    }
+
+
+    std::size_t find_two_way(const char* haystack, std::size_t size) const noexcept
+    {
+        auto h = reinterpret_cast<const unsigned char*>(haystack);
+        auto n = reinterpret_cast<const unsigned char*>(needle_.data());
+        std::size_t l = needle_.size();
+        std::size_t ms = critical_position_;
+        std::size_t mem{0};
+        std::size_t pos{0};
+
+        while (size - pos >= l) {
+
+            // Check the last byte first and advance by the Horspool shift on mismatch
+            std::size_t shift = l - shift_[h[pos + l - 1]];
+            if (shift) {
+                pos += std::max(shift, mem);
+                mem = 0;
+                continue;
+            }
+
+            // Compare the right half
+            std::size_t k = std::max(ms + 1, mem);
+            while (k < l && n[k] == h[pos + k])
+                ++k;
+
+            if (k < l) {
+                pos += k - ms;
+                mem = 0;
+                continue;
+            }
+
+            // Compare the left half
+            k = ms + 1;
+            while (k > mem && n[k - 1] == h[pos + k - 1])
+                --k;
+
+            if (k <= mem)
+                return pos;
+
+            pos += period_;
+            mem = memory_after_period_;
+        }
+
+        return std::string_view::npos;
+    }
+
+
+    std::string_view needle_;
+    std::array<std::size_t, 256> shift_;
+    std::size_t critical_position_{0};
+    std::size_t period_{0};
+    std::size_t memory_after_period_{0};
+};
+
+
+
+/**
+ * Maps offsets in the folded haystack back to offsets in the original haystack. Offsets must be
+ * increasing and on code point boundaries, so the whole haystack is walked at most once.
+ */
+template<class Decoder>
+class Fold_cursor {
+public:
+
+    explicit Fold_cursor(std::string_view v) noexcept: v_{v}
+    {
+    }
+
+    std::size_t seek(std::size_t folded_target) noexcept
+    {
+        assert(folded_target >= folded_pos_);
+
+        while (folded_pos_ != folded_target) {
+            // Folding ASCII keeps the length
+            std::size_t run = u8_simd::kernels().ascii_run_length(v_.data() + pos_, std::min(v_.size() - pos_, folded_target - folded_pos_));
+            pos_ += run;
+            folded_pos_ += run;
+            if (folded_pos_ == folded_target)
+                break;
+
+            // Lower casing keeps U+00C0 to U+00FF at two bytes
+            if (u8_decoder::is_c3_sequence(v_.data() + pos_, v_.size() - pos_)) {
+                pos_ += 2;
+                folded_pos_ += 2;
+                continue;
+            }
+
+            auto decoded = Decoder::decode(v_.data() + pos_, v_.size() - pos_);
+            pos_ += decoded.byte_count;
+            folded_pos_ += utf8_byte_count(decoded.code_point.as_lower_case());
+        }
+
+        return pos_;
+    }
+
+private:
+
+    std::string_view v_;
+    std::size_t pos_{0};
+    std::size_t folded_pos_{0};
+};
+
+
+
+/**
+ * Fold the haystack chunk by chunk on the stack and call on_window(buffer, size, folded_offset) for every window
+ * until it returns false. The last carry folded bytes of every window are carried over into the next one, so matches
+ * of carry + 1 bytes crossing chunks are found. folded_offset is the offset of the window in the folded haystack.
+ */
+template<class Decoder, class On_window, class Folding = Lower_folding>
+void for_each_folded_window(std::string_view haystack, std::size_t carry, On_window on_window)
+{
+    constexpr std::size_t stack_chunk_size = 4096;
+    std::array<char, stack_chunk_size> stack_buffer;
+    std::string heap_buffer;
+
+    // Keep chunks large compared to the carried bytes, so long needles don't search the same bytes too often
+    char* buffer = stack_buffer.data();
+    std::size_t buffer_size = stack_chunk_size;
+    if (carry * 4 > stack_chunk_size) {
+        heap_buffer.resize(carry * 4 + 4);
+        buffer = heap_buffer.data();
+        buffer_size = heap_buffer.size();
+    }
+
+    std::size_t pos{0};
+    std::size_t kept{0};
+    std::size_t folded_offset{0};
+
+    while (pos != haystack.size()) {
+        auto result = fold_chunk<Decoder, Folding>(haystack.data() + pos, haystack.size() - pos, buffer + kept, buffer_size - kept);
+        pos += result.consumed;
+
+        std::size_t size = kept + result.produced;
+        if (!on_window(static_cast<const char*>(buffer), size, folded_offset))
+            return;
+
+        std::size_t next_kept = std::min(carry, size);
+        std::memmove(buffer, buffer + size - next_kept, next_kept);
+        folded_offset += size - next_kept;
+        kept = next_kept;
+    }
+}
+
+
+/**
+ * Does the haystack contain the folded needle of the searcher?
+ */
+template<class Decoder, class Folding = Lower_folding>
+bool contains_folded(std::string_view haystack, const Searcher& searcher)
+{
+    bool found{false};
+    auto on_window = [&](const char* buffer, std::size_t size, std::size_t) {
+        found = searcher.find(buffer, size) != std::string_view::npos;
+        return !found;
+    };
+    for_each_folded_window<Decoder, decltype(on_window), Folding>(haystack, searcher.needle_size() - 1, on_window);
+
+    return found;
+}
+
+
+/**
+ * Does the haystack contain the folded needle?
+ */
+template<class Decoder>
+bool contains_folded(std::string_view haystack, std::string_view folded_needle)
+{
+    if (folded_needle.empty())
+        return true;
+
+    // A single folded byte is an ASCII character, and only ASCII bytes fold to ASCII
+    if (folded_needle.size() == 1)
+        return u8_simd::kernels().find_ascii_ibyte(haystack.data(), haystack.size(), folded_needle[0]) != haystack.size();
+
+    return contains_folded<Decoder>(haystack, Searcher{folded_needle});
+}
+
+
+/**
+ * Call on_match(begin, end) with the original byte offsets of the non-overlapping matches until it returns false.
+ */
+template<class Decoder, class On_match>
+void for_each_folded_match(std::string_view haystack, const Searcher& searcher, On_match on_match)
+{
+    std::size_t m = searcher.needle_size();
+    std::size_t next_folded_begin{0};
+    Fold_cursor<Decoder> cursor{haystack};
+
+    for_each_folded_window<Decoder>(haystack, m - 1, [&](const char* buffer, std::size_t size, std::size_t folded_offset) {
+        std::size_t start = next_folded_begin > folded_offset ? next_folded_begin - folded_offset : 0;
+
+        while (start < size) {
+            std::size_t found = searcher.find(buffer + start, size - start);
+            if (found == std::string_view::npos)
+                break;
+
+            std::size_t folded_begin = folded_offset + start + found;
+            std::size_t begin = cursor.seek(folded_begin);
+            std::size_t end = cursor.seek(folded_begin + m);
+            if (!on_match(begin, end))
+                return false;
+
+            next_folded_begin = folded_begin + m;
+            start += found + m;
+        }
+
+        return true;
+    });
+}
+
+
+}
@@ -0,0 +1,274 @@
+#include "audaki/u8string.h"
+
+#include <atomic>
+
+
+
+namespace {
+
+/**
+ * A string to sort: the first eight key bytes as a big endian number, so comparing prefixes compares the keys
+ * up to there, and the index of the string.
+ */
+struct Entry {
+    uint64_t prefix;
+    std::size_t index;
+};
+
+
+class Sorter {
+public:
+
+    Sorter(const std::vector<std::string_view>& strings, Execution execution):
+        strings_{strings},
+        thread_count_{execution == Execution::parallel && strings.size() >= min_parallel_size ? Thread_pool::shared().thread_count() : 1}
+    {
+    }
+
+    std::vector<std::size_t> sort()
+    {
+        make_keys();
+
+        std::vector<Entry> entries(strings_.size());
+        for_each_range(entries.size(), [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i != end; ++i)
+                entries[i] = {key_prefix(i), i};
+        });
+
+        std::vector<Entry> scratch(entries.size());
+        if (thread_count_ == 1)
+            radix_sort(entries.data(), scratch.data(), entries.size(), 0);
+        else
+            parallel_radix_sort(entries.data(), scratch.data(), entries.size());
+
+        std::vector<std::size_t> order(entries.size());
+        for (std::size_t i{0}; i != entries.size(); ++i)
+            order[i] = entries[i].index;
+
+        return order;
+    }
+
+private:
+
+    static constexpr std::size_t min_parallel_size = 1 << 14;
+    static constexpr std::size_t min_radix_size = 64;
+
+
+    /**
+     * Call f(begin, end) for ranges of batch_grain_size covering [0, n), on the shared pool if sorting in parallel.
+     */
+    template<class F>
+    void for_each_range(std::size_t n, F f) const
+    {
+        if (thread_count_ == 1) {
+            f(std::size_t{0}, n);
+            return;
+        }
+
+        std::size_t task_count = (n + batch_grain_size - 1) / batch_grain_size;
+        Thread_pool::shared().run(task_count, [&](std::size_t task_index) {
+            std::size_t begin = task_index * batch_grain_size;
+            f(begin, std::min(n, begin + batch_grain_size));
+        });
+    }
+
+
+    /**
+     * Lower case all strings into one buffer, the key of string i is keys_[key_offsets_[i], key_offsets_[i + 1]).
+     */
+    void make_keys()
+    {
+        key_offsets_.assign(strings_.size() + 1, 0);
+        for_each_range(strings_.size(), [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i != end; ++i)
+                key_offsets_[i + 1] = lower_cased_size(strings_[i]);
+        });
+
+        for (std::size_t i{0}; i != strings_.size(); ++i)
+            key_offsets_[i + 1] += key_offsets_[i];
+
+        keys_.resize(key_offsets_.back());
+        for_each_range(strings_.size(), [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i != end; ++i)
+                to_lower_into(strings_[i], keys_.data() + key_offsets_[i]);
+        });
+    }
+
+    std::string_view key(std::size_t i) const noexcept
+    {
+        return std::string_view{keys_}.substr(key_offsets_[i], key_offsets_[i + 1] - key_offsets_[i]);
+    }
+
+    /**
+     * Eight key bytes from depth on, padded with zeros.
+     */
+    uint64_t key_prefix(std::size_t i, std::size_t depth = 0) const noexcept
+    {
+        auto k = key(i);
+        uint64_t prefix{0};
+        for (std::size_t b = depth; b != depth + 8; ++b)
+            prefix = (prefix << 8) | (b < k.size() ? static_cast<uint8_t>(k[b]) : 0u);
+
+        return prefix;
+    }
+
+    /**
+     * Order of entries whose keys agree before depth, the prefixes hold the key bytes from depth on. Equal keys
+     * keep their original order, so the sort is stable.
+     */
+    bool less(const Entry& e1, const Entry& e2, std::size_t depth) const noexcept
+    {
+        if (e1.prefix != e2.prefix)
+            return e1.prefix < e2.prefix;
+
+        // Short keys are padded with zeros, so equal prefixes still need the whole keys
+        auto k1 = key(e1.index);
+        auto k2 = key(e2.index);
+        std::size_t skip = std::min({depth + 8, k1.size(), k2.size()});
+        int c = k1.substr(skip).compare(k2.substr(skip));
+        return c != 0 ? c < 0 : e1.index < e2.index;
+    }
+
+
+    static std::size_t digit(const Entry& e, std::size_t byte) noexcept
+    {
+        return (e.prefix >> (56 - 8 * byte)) & 0xFF;
+    }
+
+    using Buckets = std::array<std::size_t, 257>;
+
+    /**
+     * Stable counting sort of entries by the prefix byte, returns the bucket boundaries.
+     */
+    static Buckets distribute(Entry* entries, Entry* scratch, std::size_t n, std::size_t byte) noexcept
+    {
+        Buckets buckets{};
+        for (std::size_t i{0}; i != n; ++i)
+            ++buckets[digit(entries[i], byte) + 1];
+
+        for (std::size_t b{0}; b != 256; ++b)
+            buckets[b + 1] += buckets[b];
+
+        Buckets next = buckets;
+        for (std::size_t i{0}; i != n; ++i)
+            scratch[next[digit(entries[i], byte)]++] = entries[i];
+
+        std::copy_n(scratch, n, entries);
+        return buckets;
+    }
+
+    /**
+     * First prefix byte from byte on which not all entries agree, or 8. Skips common prefixes like "Customer Nr. ".
+     */
+    static std::size_t first_distinct_byte(const Entry* entries, std::size_t n, std::size_t byte) noexcept
+    {
+        auto is_common = [&](std::size_t b) {
+            return std::all_of(entries, entries + n, [&](const Entry& e) { return digit(e, b) == digit(entries[0], b); });
+        };
+
+        while (byte != 8 && is_common(byte))
+            ++byte;
+
+        return byte;
+    }
+
+    /**
+     * MSD radix sort over the prefix bytes, small buckets are sorted by comparison. Once the prefixes of a bucket
+     * are exhausted, they are reloaded with the next eight key bytes.
+     */
+    void radix_sort(Entry* entries, Entry* scratch, std::size_t n, std::size_t byte, std::size_t depth = 0) const
+    {
+        if (n >= min_radix_size)
+            byte = first_distinct_byte(entries, n, byte);
+
+        if (byte == 8 && n >= min_radix_size && reload_prefixes(entries, n, depth + 8)) {
+            radix_sort(entries, scratch, n, 0, depth + 8);
+            return;
+        }
+
+        if (n < min_radix_size || byte == 8) {
+            std::sort(entries, entries + n, [this, depth](const Entry& e1, const Entry& e2) { return less(e1, e2, depth); });
+            return;
+        }
+
+        auto buckets = distribute(entries, scratch, n, byte);
+        for (std::size_t b{0}; b != 256; ++b) {
+            std::size_t size = buckets[b + 1] - buckets[b];
+            if (size > 1)
+                radix_sort(entries + buckets[b], scratch + buckets[b], size, byte + 1, depth);
+        }
+    }
+
+    /**
+     * Load the key bytes from depth on into the prefixes, unless no key is longer than depth.
+     */
+    bool reload_prefixes(Entry* entries, std::size_t n, std::size_t depth) const noexcept
+    {
+        bool has_longer_keys = std::any_of(entries, entries + n, [&](const Entry& e) { return key(e.index).size() > depth; });
+        if (!has_longer_keys)
+            return false;
+
+        for (std::size_t i{0}; i != n; ++i)
+            entries[i].prefix = key_prefix(entries[i].index, depth);
+
+        return true;
+    }
+
+    /**
+     * Distribute by the first distinct byte, then sort the buckets on all threads, largest first.
+     */
+    void parallel_radix_sort(Entry* entries, Entry* scratch, std::size_t n) const
+    {
+        std::size_t byte = first_distinct_byte(entries, n, 0);
+        if (byte == 8) {
+            radix_sort(entries, scratch, n, byte);
+            return;
+        }
+
+        auto buckets = distribute(entries, scratch, n, byte);
+
+        std::array<std::size_t, 256> by_size;
+        std::iota(by_size.begin(), by_size.end(), 0);
+        std::sort(by_size.begin(), by_size.end(), [&](std::size_t b1, std::size_t b2) {
+            return buckets[b1 + 1] - buckets[b1] > buckets[b2 + 1] - buckets[b2];
+        });
+
+        // One task per thread, each takes the largest bucket left
+        std::atomic<std::size_t> next{0};
+        Thread_pool::shared().run(thread_count_, [&](std::size_t) {
+            for (std::size_t i = next++; i < by_size.size(); i = next++) {
+                std::size_t b = by_size[i];
+                std::size_t size = buckets[b + 1] - buckets[b];
+                if (size > 1)
+                    radix_sort(entries + buckets[b], scratch + buckets[b], size, byte + 1, 0);
+            }
+        });
+    }
+
+
+    const std::vector<std::string_view>& strings_;
+    std::size_t thread_count_;
+    std::string keys_;
+    std::vector<std::size_t> key_offsets_;
+};
+
+}
+
+
+
+std::string make_isort_key(Utf8_view v)
+{
+    return as_lower_cased_string(v);
+}
+
+
+std::string make_isort_key(Validated_utf8_view v)
+{
+    return as_lower_cased_string(v);
+}
+
+
+std::vector<std::size_t> u8_isort_order(const std::vector<std::string_view>& strings, Execution execution)
+{
+    return Sorter{strings, execution}.sort();
+}
@@ -0,0 +1,405 @@
+#include "audaki/u8string.h"
+
+#include <queue>
+
+
+
+namespace {
+
+constexpr std::array<char, 8> prefix_index_magic{'A', 'U', '8', 'P', 'R', 'E', 'F', 'X'};
+constexpr uint32_t prefix_index_byte_order = 0x01020304;
+constexpr uint32_t prefix_index_version = 1;
+constexpr uint32_t has_weights_flag = 1;
+
+
+/**
+ * Beginning of the flat buffer, the sections follow in the order of Sections.
+ */
+struct Header {
+    std::array<char, 8> magic;
+    uint32_t byte_order;
+    uint32_t version;
+    uint64_t entry_count;
+    uint64_t leaf_count;
+    uint64_t key_size;
+    uint64_t entry_size;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+
+/**
+ * Byte offsets of the sections in the buffer, all 8 byte aligned:
+ *
+ *     key_offsets    entry_count + 1 uint64_t, key i is keys[key_offsets[i], key_offsets[i + 1])
+ *     entry_offsets  entry_count + 1 uint64_t, the same for the entries as they were given
+ *     indices        entry_count uint32_t, the index of the entry in the range the index was built from
+ *     weights        entry_count uint32_t, if there are weights
+ *     tree           2 * leaf_count uint32_t, if there are weights: the max tree of the positions by weight
+ *     keys           key_size bytes, the lower cased entries in u8_iless order
+ *     entries        entry_size bytes
+ */
+struct Sections {
+    std::size_t key_offsets;
+    std::size_t entry_offsets;
+    std::size_t indices;
+    std::size_t weights;
+    std::size_t tree;
+    std::size_t keys;
+    std::size_t entries;
+    std::size_t end;
+};
+
+
+std::size_t align8(std::size_t size) noexcept
+{
+    return (size + 7) & ~std::size_t{7};
+}
+
+
+Sections sections_of(const Header& header) noexcept
+{
+    bool has_weights = header.flags & has_weights_flag;
+    Sections sections{};
+    sections.key_offsets = sizeof(Header);
+    sections.entry_offsets = sections.key_offsets + (header.entry_count + 1) * sizeof(uint64_t);
+    sections.indices = sections.entry_offsets + (header.entry_count + 1) * sizeof(uint64_t);
+    sections.weights = sections.indices + align8(header.entry_count * sizeof(uint32_t));
+    sections.tree = sections.weights + (has_weights ? align8(header.entry_count * sizeof(uint32_t)) : 0);
+    sections.keys = sections.tree + (has_weights ? 2 * header.leaf_count * sizeof(uint32_t) : 0);
+    sections.entries = sections.keys + align8(header.key_size);
+    sections.end = sections.entries + align8(header.entry_size);
+    return sections;
+}
+
+
+/**
+ * Call body(begin, end) for all of [0, size), split into batch tasks on the shared pool for parallel execution.
+ */
+template<class Body>
+void for_each_range(std::size_t size, Execution execution, Body&& body)
+{
+    if (execution == Execution::sequential) {
+        body(std::size_t{0}, size);
+        return;
+    }
+
+    std::size_t task_count = (size + batch_grain_size - 1) / batch_grain_size;
+    Thread_pool::shared().run(task_count, [&](std::size_t task_index) {
+        std::size_t begin = task_index * batch_grain_size;
+        body(begin, std::min(size, begin + batch_grain_size));
+    });
+}
+
+
+/**
+ * Offsets of consecutive pieces of the given sizes, with the total at the end.
+ */
+void prefix_sums(const std::vector<uint64_t>& sizes, uint64_t* offsets) noexcept
+{
+    offsets[0] = 0;
+    for (std::size_t i{0}; i != sizes.size(); ++i)
+        offsets[i + 1] = offsets[i] + sizes[i];
+}
+
+
+bool is_ascending(const uint64_t* offsets, std::size_t count, uint64_t end) noexcept
+{
+    if (offsets[0] != 0 || offsets[count] != end)
+        return false;
+
+    for (std::size_t i{0}; i != count; ++i) {
+        if (offsets[i] > offsets[i + 1])
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+
+
+struct Icase_prefix_index::Layout {
+
+    /**
+     * Point into buffer, which holds a complete index.
+     */
+    explicit Layout(std::string_view buffer) noexcept: buffer{buffer}
+    {
+        std::memcpy(&header, buffer.data(), sizeof(Header));
+        auto sections = sections_of(header);
+        key_offsets = reinterpret_cast<const uint64_t*>(buffer.data() + sections.key_offsets);
+        entry_offsets = reinterpret_cast<const uint64_t*>(buffer.data() + sections.entry_offsets);
+        indices = reinterpret_cast<const uint32_t*>(buffer.data() + sections.indices);
+        weights = reinterpret_cast<const uint32_t*>(buffer.data() + sections.weights);
+        tree = reinterpret_cast<const uint32_t*>(buffer.data() + sections.tree);
+        keys = buffer.data() + sections.keys;
+        entries = buffer.data() + sections.entries;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return static_cast<std::size_t>(header.entry_count);
+    }
+
+    bool has_weights() const noexcept
+    {
+        return header.flags & has_weights_flag;
+    }
+
+    std::string_view key(std::size_t position) const noexcept
+    {
+        return {keys + key_offsets[position], static_cast<std::size_t>(key_offsets[position + 1] - key_offsets[position])};
+    }
+
+    std::string_view entry(std::size_t position) const noexcept
+    {
+        return {entries + entry_offsets[position], static_cast<std::size_t>(entry_offsets[position + 1] - entry_offsets[position])};
+    }
+
+    /**
+     * Positions of the keys which start with folded_prefix.
+     */
+    std::pair<std::size_t, std::size_t> range(std::string_view folded_prefix) const noexcept
+    {
+        auto first_where = [&](std::size_t begin, std::size_t end, auto is_past) {
+            while (begin != end) {
+                std::size_t middle = begin + (end - begin) / 2;
+                if (is_past(key(middle)))
+                    end = middle;
+                else
+                    begin = middle + 1;
+            }
+            return begin;
+        };
+
+        std::size_t begin = first_where(0, size(), [&](std::string_view key) {
+            return key >= folded_prefix;
+        });
+        std::size_t end = first_where(begin, size(), [&](std::string_view key) {
+            return key.substr(0, folded_prefix.size()) > folded_prefix;
+        });
+
+        return {begin, end};
+    }
+
+    /**
+     * The better of two positions: the higher weight, the first one among equal weights. size() is no position.
+     */
+    std::size_t better(std::size_t a, std::size_t b) const noexcept
+    {
+        if (a == size() || b == size())
+            return std::min(a, b);
+
+        if (weights[a] != weights[b])
+            return weights[a] > weights[b] ? a : b;
+
+        return std::min(a, b);
+    }
+
+    /**
+     * The best position of [begin, end) by the max tree.
+     */
+    std::size_t best(std::size_t begin, std::size_t end) const noexcept
+    {
+        std::size_t result = size();
+        std::size_t leaf_count = static_cast<std::size_t>(header.leaf_count);
+        for (begin += leaf_count, end += leaf_count; begin < end; begin /= 2, end /= 2) {
+            if (begin & 1)
+                result = better(result, tree[begin++]);
+            if (end & 1)
+                result = better(result, tree[--end]);
+        }
+
+        return result;
+    }
+
+    Icase_completion completion(std::size_t position) const noexcept
+    {
+        return {indices[position], entry(position), has_weights() ? weights[position] : 0};
+    }
+
+    // Storage of built indexes, views refer to the buffer of the caller
+    std::vector<uint64_t> owned;
+    std::string_view buffer;
+
+    Header header;
+    const uint64_t* key_offsets;
+    const uint64_t* entry_offsets;
+    const uint32_t* indices;
+    const uint32_t* weights;
+    const uint32_t* tree;
+    const char* keys;
+    const char* entries;
+};
+
+
+
+Icase_prefix_index::Icase_prefix_index(const std::vector<std::string_view>& entries, const std::vector<uint32_t>& weights, Execution execution)
+{
+    assert(weights.empty() || weights.size() == entries.size());
+    assert(entries.size() < std::size_t{1} << 32);
+
+    std::size_t n = entries.size();
+    std::vector<std::size_t> order = u8_isort_order(entries, execution);
+
+    std::vector<uint64_t> key_sizes(n);
+    std::vector<uint64_t> entry_sizes(n);
+    for_each_range(n, execution, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            key_sizes[i] = lower_cased_size(entries[order[i]]);
+            entry_sizes[i] = entries[order[i]].size();
+        }
+    });
+
+    Header header{};
+    header.magic = prefix_index_magic;
+    header.byte_order = prefix_index_byte_order;
+    header.version = prefix_index_version;
+    header.entry_count = n;
+    header.leaf_count = 1;
+    while (header.leaf_count < n)
+        header.leaf_count *= 2;
+    header.key_size = std::accumulate(key_sizes.begin(), key_sizes.end(), uint64_t{0});
+    header.entry_size = std::accumulate(entry_sizes.begin(), entry_sizes.end(), uint64_t{0});
+    header.flags = weights.empty() ? 0 : has_weights_flag;
+
+    auto sections = sections_of(header);
+    std::vector<uint64_t> owned(sections.end / sizeof(uint64_t));
+    char* buffer = reinterpret_cast<char*>(owned.data());
+    std::memcpy(buffer, &header, sizeof(Header));
+    prefix_sums(key_sizes, reinterpret_cast<uint64_t*>(buffer + sections.key_offsets));
+    prefix_sums(entry_sizes, reinterpret_cast<uint64_t*>(buffer + sections.entry_offsets));
+
+    auto layout = std::make_shared<Layout>(std::string_view{buffer, sections.end});
+    auto indices = reinterpret_cast<uint32_t*>(buffer + sections.indices);
+    auto sorted_weights = reinterpret_cast<uint32_t*>(buffer + sections.weights);
+    for_each_range(n, execution, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            Utf8_view entry = entries[order[i]];
+            to_lower_into(entry, buffer + sections.keys + layout->key_offsets[i]);
+            std::memcpy(buffer + sections.entries + layout->entry_offsets[i], entry.v_.data(), entry.v_.size());
+            indices[i] = static_cast<uint32_t>(order[i]);
+            if (!weights.empty())
+                sorted_weights[i] = weights[order[i]];
+        }
+    });
+
+    if (!weights.empty()) {
+        std::size_t leaf_count = static_cast<std::size_t>(header.leaf_count);
+        auto tree = reinterpret_cast<uint32_t*>(buffer + sections.tree);
+        for (std::size_t i{0}; i != leaf_count; ++i)
+            tree[leaf_count + i] = static_cast<uint32_t>(std::min(i, n));
+        for (std::size_t node = leaf_count - 1; node != 0; --node)
+            tree[node] = static_cast<uint32_t>(layout->better(tree[2 * node], tree[2 * node + 1]));
+    }
+
+    layout->owned = std::move(owned);
+    layout_ = std::move(layout);
+}
+
+
+Icase_prefix_index::Icase_prefix_index(std::shared_ptr<const Layout> layout) noexcept: layout_{std::move(layout)}
+{
+}
+
+
+std::optional<Icase_prefix_index> Icase_prefix_index::view(std::string_view buffer) noexcept
+{
+    Header header;
+    if (buffer.size() < sizeof(Header) || reinterpret_cast<uintptr_t>(buffer.data()) % alignof(uint64_t) != 0)
+        return std::nullopt;
+
+    std::memcpy(&header, buffer.data(), sizeof(Header));
+    if (header.magic != prefix_index_magic || header.byte_order != prefix_index_byte_order || header.version != prefix_index_version)
+        return std::nullopt;
+
+    // Bound all counts by the buffer size first, so computing the sections can't overflow
+    if (header.entry_count >= buffer.size() || header.leaf_count > 2 * header.entry_count + 1 || header.key_size > buffer.size() || header.entry_size > buffer.size())
+        return std::nullopt;
+
+    if (header.leaf_count == 0 || (header.leaf_count & (header.leaf_count - 1)) != 0 || header.leaf_count < header.entry_count)
+        return std::nullopt;
+
+    if (sections_of(header).end != buffer.size())
+        return std::nullopt;
+
+    // Validate everything used to address the buffer, so a corrupt file can't make lookups read out of it
+    auto layout = std::make_shared<Layout>(buffer);
+    std::size_t n = layout->size();
+    if (!is_ascending(layout->key_offsets, n, header.key_size) || !is_ascending(layout->entry_offsets, n, header.entry_size))
+        return std::nullopt;
+
+    if (layout->has_weights()) {
+        std::size_t leaf_count = static_cast<std::size_t>(header.leaf_count);
+        for (std::size_t node{1}; node != 2 * leaf_count; ++node) {
+            if (layout->tree[node] > n)
+                return std::nullopt;
+        }
+    }
+
+    return Icase_prefix_index{std::move(layout)};
+}
+
+
+std::size_t Icase_prefix_index::size() const noexcept
+{
+    return layout_->size();
+}
+
+
+std::size_t Icase_prefix_index::count(Utf8_view prefix) const
+{
+    auto [begin, end] = layout_->range(as_lower_cased_string(prefix));
+    return end - begin;
+}
+
+
+std::vector<Icase_completion> Icase_prefix_index::top_k(Utf8_view prefix, std::size_t k) const
+{
+    const Layout& layout = *layout_;
+    auto [begin, end] = layout.range(as_lower_cased_string(prefix));
+    std::vector<Icase_completion> completions;
+    if (!layout.has_weights()) {
+        std::size_t count = std::min(k, end - begin);
+        for (std::size_t position = begin; position != begin + count; ++position)
+            completions.push_back(layout.completion(position));
+
+        return completions;
+    }
+
+    // The best of a range splits it in two, the best of the parts are the next candidates
+    struct Candidate {
+        std::size_t position;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    auto is_worse = [&](const Candidate& a, const Candidate& b) {
+        return layout.better(a.position, b.position) == b.position;
+    };
+
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(is_worse)> candidates{is_worse};
+    if (begin != end)
+        candidates.push({layout.best(begin, end), begin, end});
+
+    while (completions.size() != k && !candidates.empty()) {
+        Candidate candidate = candidates.top();
+        candidates.pop();
+        completions.push_back(layout.completion(candidate.position));
+
+        if (candidate.begin != candidate.position)
+            candidates.push({layout.best(candidate.begin, candidate.position), candidate.begin, candidate.position});
+        if (candidate.position + 1 != candidate.end)
+            candidates.push({layout.best(candidate.position + 1, candidate.end), candidate.position + 1, candidate.end});
+    }
+
+    return completions;
+}
+
+
+std::string_view Icase_prefix_index::buffer() const noexcept
+{
+    return layout_->buffer;
+}
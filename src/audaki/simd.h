@@ -0,0 +1,1251 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(AUDAKI_U8STRING_NO_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The kernels are compiled once per instruction set level for the runtime dispatch in simd_kernels.h, each level
+// gets its own namespace so the inline functions of different levels don't violate the one definition rule
+#if defined(AUDAKI_U8STRING_NO_SIMD)
+#define AUDAKI_U8STRING_SIMD_NAMESPACE swar
+#elif defined(__AVX2__)
+#define AUDAKI_U8STRING_SIMD_NAMESPACE avx2
+#elif defined(__SSE4_2__) && defined(__POPCNT__)
+#define AUDAKI_U8STRING_SIMD_NAMESPACE sse42
+#elif defined(__SSSE3__)
+#define AUDAKI_U8STRING_SIMD_NAMESPACE ssse3
+#elif defined(__SSE2__)
+#define AUDAKI_U8STRING_SIMD_NAMESPACE sse2
+#else
+#define AUDAKI_U8STRING_SIMD_NAMESPACE swar
+#endif
+
+
+
+/**
+ * Byte kernels for the ASCII fast paths and UTF-8 validation.
+ *
+ * Each kernel works on the widest vector the translation unit is compiled for (AVX2, SSE2) and
+ * falls back to 8-byte SWAR words and finally to single bytes for the tail.
+ */
+namespace u8_simd {
+
+
+/**
+ * The tables of a Byte_class for the class search kernels. low_nibbles and high_nibbles are null if the class
+ * has no nibble tables, bytes is null if it has more than the bytes compared one by one.
+ */
+struct Class_tables {
+    const uint64_t* bitmap;
+    const uint8_t* low_nibbles;
+    const uint8_t* high_nibbles;
+    const char* bytes;
+    std::size_t byte_count;
+};
+
+
+inline namespace AUDAKI_U8STRING_SIMD_NAMESPACE {
+
+
+#if defined(AUDAKI_U8STRING_NO_SIMD)
+#elif defined(__AVX2__)
+
+struct Bytes {
+    static constexpr std::size_t size = 32;
+
+    static Bytes load(const char* p) noexcept
+    {
+        return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))};
+    }
+
+    static Bytes splat(char c) noexcept
+    {
+        return {_mm256_set1_epi8(c)};
+    }
+
+    void store(char* p) const noexcept
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+    }
+
+    Bytes operator==(Bytes o) const noexcept { return {_mm256_cmpeq_epi8(v, o.v)}; }
+    Bytes operator>(Bytes o) const noexcept { return {_mm256_cmpgt_epi8(v, o.v)}; }
+    Bytes operator<(Bytes o) const noexcept { return {_mm256_cmpgt_epi8(o.v, v)}; }
+    Bytes operator&(Bytes o) const noexcept { return {_mm256_and_si256(v, o.v)}; }
+    Bytes operator|(Bytes o) const noexcept { return {_mm256_or_si256(v, o.v)}; }
+    Bytes operator^(Bytes o) const noexcept { return {_mm256_xor_si256(v, o.v)}; }
+
+    /**
+     * One bit per byte, set if the most significant bit of the byte is set.
+     */
+    uint32_t mask() const noexcept
+    {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+    }
+
+    bool any() const noexcept
+    {
+        return !_mm256_testz_si256(v, v);
+    }
+
+    static Bytes zero() noexcept
+    {
+        return {_mm256_setzero_si256()};
+    }
+
+    /**
+     * Byte-wise shift right by 4, i.e. the high nibbles.
+     */
+    Bytes high_nibbles() const noexcept
+    {
+        return {_mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F))};
+    }
+
+    Bytes low_nibbles() const noexcept
+    {
+        return {_mm256_and_si256(v, _mm256_set1_epi8(0x0F))};
+    }
+
+    Bytes saturating_sub(Bytes o) const noexcept
+    {
+        return {_mm256_subs_epu8(v, o.v)};
+    }
+
+    /**
+     * The low bytes of the 32 code units at p, which must all be below 0x100.
+     */
+    static Bytes load_narrowed(const char16_t* p) noexcept
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 16));
+        return {_mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8)};
+    }
+
+    static Bytes load_narrowed(const char32_t* p) noexcept
+    {
+        auto load = [p](std::size_t i) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)); };
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(load(0), load(8)), _mm256_packs_epi32(load(16), load(24)));
+        return {_mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7))};
+    }
+
+    /**
+     * Store the bytes zero extended to 32 code units at p.
+     */
+    void store_widened(char16_t* p) const noexcept
+    {
+        auto out = reinterpret_cast<__m256i*>(p);
+        _mm256_storeu_si256(out, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    }
+
+    void store_widened(char32_t* p) const noexcept
+    {
+        auto out = reinterpret_cast<__m256i*>(p);
+        __m128i low = _mm256_castsi256_si128(v);
+        __m128i high = _mm256_extracti128_si256(v, 1);
+        _mm256_storeu_si256(out, _mm256_cvtepu8_epi32(low));
+        _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+        _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(high));
+        _mm256_storeu_si256(out + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+    }
+
+    /**
+     * Use every byte (which must be < 16) as index into the 16 byte table.
+     */
+    Bytes lookup16(const uint8_t* table) const noexcept
+    {
+        __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+        return {_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), v)};
+    }
+
+    /**
+     * The bytes shifted by N positions, the first N bytes come from the end of previous.
+     */
+    template<int N>
+    Bytes prev(Bytes previous) const noexcept
+    {
+        return {_mm256_alignr_epi8(v, _mm256_permute2x128_si256(previous.v, v, 0x21), 16 - N)};
+    }
+
+    __m256i v;
+};
+
+#define AUDAKI_U8STRING_SIMD 1
+#define AUDAKI_U8STRING_SIMD_LOOKUP 1
+
+#elif defined(__SSE2__)
+
+struct Bytes {
+    static constexpr std::size_t size = 16;
+
+    static Bytes load(const char* p) noexcept
+    {
+        return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))};
+    }
+
+    static Bytes splat(char c) noexcept
+    {
+        return {_mm_set1_epi8(c)};
+    }
+
+    void store(char* p) const noexcept
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+    }
+
+    Bytes operator==(Bytes o) const noexcept { return {_mm_cmpeq_epi8(v, o.v)}; }
+    Bytes operator>(Bytes o) const noexcept { return {_mm_cmpgt_epi8(v, o.v)}; }
+    Bytes operator<(Bytes o) const noexcept { return {_mm_cmplt_epi8(v, o.v)}; }
+    Bytes operator&(Bytes o) const noexcept { return {_mm_and_si128(v, o.v)}; }
+    Bytes operator|(Bytes o) const noexcept { return {_mm_or_si128(v, o.v)}; }
+    Bytes operator^(Bytes o) const noexcept { return {_mm_xor_si128(v, o.v)}; }
+
+    /**
+     * One bit per byte, set if the most significant bit of the byte is set.
+     */
+    uint32_t mask() const noexcept
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(v));
+    }
+
+    bool any() const noexcept
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+    }
+
+    static Bytes zero() noexcept
+    {
+        return {_mm_setzero_si128()};
+    }
+
+    /**
+     * Byte-wise shift right by 4, i.e. the high nibbles.
+     */
+    Bytes high_nibbles() const noexcept
+    {
+        return {_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F))};
+    }
+
+    Bytes low_nibbles() const noexcept
+    {
+        return {_mm_and_si128(v, _mm_set1_epi8(0x0F))};
+    }
+
+    Bytes saturating_sub(Bytes o) const noexcept
+    {
+        return {_mm_subs_epu8(v, o.v)};
+    }
+
+    /**
+     * The low bytes of the 16 code units at p, which must all be below 0x100.
+     */
+    static Bytes load_narrowed(const char16_t* p) noexcept
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8));
+        return {_mm_packus_epi16(a, b)};
+    }
+
+    static Bytes load_narrowed(const char32_t* p) noexcept
+    {
+        auto load = [p](std::size_t i) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)); };
+        return {_mm_packus_epi16(_mm_packs_epi32(load(0), load(4)), _mm_packs_epi32(load(8), load(12)))};
+    }
+
+    /**
+     * Store the bytes zero extended to 16 code units at p.
+     */
+    void store_widened(char16_t* p) const noexcept
+    {
+        auto out = reinterpret_cast<__m128i*>(p);
+        _mm_storeu_si128(out, _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+    }
+
+    void store_widened(char32_t* p) const noexcept
+    {
+        auto out = reinterpret_cast<__m128i*>(p);
+        __m128i low = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+        __m128i high = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(low, _mm_setzero_si128()));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(low, _mm_setzero_si128()));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(high, _mm_setzero_si128()));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(high, _mm_setzero_si128()));
+    }
+
+#if defined(__SSSE3__)
+    /**
+     * Use every byte (which must be < 16) as index into the 16 byte table.
+     */
+    Bytes lookup16(const uint8_t* table) const noexcept
+    {
+        return {_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table)), v)};
+    }
+
+    /**
+     * The bytes shifted by N positions, the first N bytes come from the end of previous.
+     */
+    template<int N>
+    Bytes prev(Bytes previous) const noexcept
+    {
+        return {_mm_alignr_epi8(v, previous.v, 16 - N)};
+    }
+#endif
+
+    __m128i v;
+};
+
+#define AUDAKI_U8STRING_SIMD 1
+#if defined(__SSSE3__)
+#define AUDAKI_U8STRING_SIMD_LOOKUP 1
+#endif
+
+#endif
+
+
+
+inline unsigned count_trailing_zeros(uint64_t v) noexcept
+{
+    return static_cast<unsigned>(__builtin_ctzll(v));
+}
+
+
+inline unsigned count_leading_zeros(uint32_t v) noexcept
+{
+    return static_cast<unsigned>(__builtin_clz(v));
+}
+
+
+inline unsigned popcount(uint32_t v) noexcept
+{
+    return static_cast<unsigned>(__builtin_popcount(v));
+}
+
+
+inline uint64_t load_word(const char* p) noexcept
+{
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+
+constexpr uint64_t word_high_bits = 0x8080'8080'8080'8080ull;
+
+
+inline char ascii_to_lower(char c) noexcept
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+
+inline char ascii_to_upper(char c) noexcept
+{
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c & ~0x20) : c;
+}
+
+
+#ifdef AUDAKI_U8STRING_SIMD
+
+/**
+ * Lower case every ASCII letter, leave all other bytes untouched.
+ */
+inline Bytes ascii_to_lower(Bytes b) noexcept
+{
+    Bytes is_upper = (b > Bytes::splat('A' - 1)) & (b < Bytes::splat('Z' + 1));
+    return b | (is_upper & Bytes::splat(0x20));
+}
+
+
+/**
+ * Upper case every ASCII letter, leave all other bytes untouched.
+ */
+inline Bytes ascii_to_upper(Bytes b) noexcept
+{
+    Bytes is_lower = (b > Bytes::splat('a' - 1)) & (b < Bytes::splat('z' + 1));
+    return b ^ (is_lower & Bytes::splat(0x20));
+}
+
+
+/**
+ * Bytes which begin a code point in the sense of is_utf8_code_point_begin: neither continuation bytes (80 to BF)
+ * nor F8 to FF. Signed, these are the bytes above BF except for -8 to -1.
+ */
+inline uint32_t code_point_begin_mask(Bytes b) noexcept
+{
+    uint32_t above_continuation = (b > Bytes::splat('\xBF')).mask();
+    uint32_t invalid = ((b > Bytes::splat('\xF7')) & (b < Bytes::zero())).mask();
+    return above_continuation & ~invalid;
+}
+
+#endif
+
+
+/**
+ * Number of leading ASCII bytes in [s, s + n).
+ */
+inline std::size_t ascii_run_length(const char* s, std::size_t n) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        uint32_t non_ascii = Bytes::load(s + i).mask();
+        if (non_ascii)
+            return i + count_trailing_zeros(non_ascii);
+    }
+#endif
+
+    for (; i + 8 <= n; i += 8) {
+        if (load_word(s + i) & word_high_bits)
+            break;
+    }
+
+    while (i != n && static_cast<uint8_t>(s[i]) < 0x80)
+        ++i;
+
+    return i;
+}
+
+
+/**
+ * Number of leading positions where a and b hold the same byte.
+ */
+inline std::size_t common_prefix_length(const char* a, const char* b, std::size_t n) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        uint32_t equal = (Bytes::load(a + i) == Bytes::load(b + i)).mask();
+        if (~equal & ((Bytes::size == 32) ? 0xFFFF'FFFFu : 0xFFFFu))
+            return i + count_trailing_zeros(~equal);
+    }
+#endif
+
+    for (; i + 8 <= n; i += 8) {
+        if (load_word(a + i) != load_word(b + i))
+            break;
+    }
+
+    while (i != n && a[i] == b[i])
+        ++i;
+
+    return i;
+}
+
+
+/**
+ * Number of leading positions where a and b both hold ASCII bytes which are equal ignoring case.
+ */
+inline std::size_t ascii_iequal_run_length(const char* a, const char* b, std::size_t n) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes va = Bytes::load(a + i);
+        Bytes vb = Bytes::load(b + i);
+        uint32_t equal = (ascii_to_lower(va) == ascii_to_lower(vb)).mask() & ~(va | vb).mask();
+        if (~equal & ((Bytes::size == 32) ? 0xFFFF'FFFFu : 0xFFFFu))
+            return i + count_trailing_zeros(~equal);
+    }
+#endif
+
+    for (; i != n; ++i) {
+        char ca = a[i];
+        char cb = b[i];
+        if (static_cast<uint8_t>(ca | cb) >= 0x80 || ascii_to_lower(ca) != ascii_to_lower(cb))
+            break;
+    }
+
+    return i;
+}
+
+
+/**
+ * Copy the leading ASCII run of [in, in + n) to out with ASCII letters lower cased.
+ * Returns the number of bytes copied.
+ */
+inline std::size_t ascii_to_lower_run(const char* in, std::size_t n, char* out) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes b = Bytes::load(in + i);
+        if (b.mask())
+            break;
+        ascii_to_lower(b).store(out + i);
+    }
+#endif
+
+    for (; i != n && static_cast<uint8_t>(in[i]) < 0x80; ++i)
+        out[i] = ascii_to_lower(in[i]);
+
+    return i;
+}
+
+
+/**
+ * Copy the leading ASCII run of [in, in + n) to out with ASCII letters upper cased.
+ * Returns the number of bytes copied.
+ */
+inline std::size_t ascii_to_upper_run(const char* in, std::size_t n, char* out) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes b = Bytes::load(in + i);
+        if (b.mask())
+            break;
+        ascii_to_upper(b).store(out + i);
+    }
+#endif
+
+    for (; i != n && static_cast<uint8_t>(in[i]) < 0x80; ++i)
+        out[i] = ascii_to_upper(in[i]);
+
+    return i;
+}
+
+
+/**
+ * Position of the first byte which is either non-ASCII or equals the lower case ASCII byte c
+ * ignoring case. Returns n if there is none.
+ */
+inline std::size_t find_ascii_ibyte_or_non_ascii(const char* s, std::size_t n, char c) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    Bytes needle = Bytes::splat(c);
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes b = Bytes::load(s + i);
+        uint32_t hits = (ascii_to_lower(b) == needle).mask() | b.mask();
+        if (hits)
+            return i + count_trailing_zeros(hits);
+    }
+#endif
+
+    for (; i != n; ++i) {
+        if (static_cast<uint8_t>(s[i]) >= 0x80 || ascii_to_lower(s[i]) == c)
+            break;
+    }
+
+    return i;
+}
+
+
+/**
+ * Like find_ascii_ibyte_or_non_ascii for a small set of up to max_ibyte_set_size lower case ASCII bytes.
+ */
+constexpr std::size_t max_ibyte_set_size = 8;
+
+inline std::size_t find_ascii_ibytes_or_non_ascii(const char* s, std::size_t n, const char* set, std::size_t set_size) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    Bytes needles[max_ibyte_set_size];
+    for (std::size_t k{0}; k != set_size; ++k)
+        needles[k] = Bytes::splat(set[k]);
+
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes b = Bytes::load(s + i);
+        Bytes lower = ascii_to_lower(b);
+        Bytes hits = b;
+        for (std::size_t k{0}; k != set_size; ++k)
+            hits = hits | (lower == needles[k]);
+
+        if (uint32_t mask = hits.mask())
+            return i + count_trailing_zeros(mask);
+    }
+#endif
+
+    for (; i != n; ++i) {
+        if (static_cast<uint8_t>(s[i]) >= 0x80 || std::memchr(set, ascii_to_lower(s[i]), set_size))
+            break;
+    }
+
+    return i;
+}
+
+
+
+
+/**
+ * Position of the first byte which equals the lower case ASCII byte c ignoring case. Returns n if there is none.
+ */
+inline std::size_t find_ascii_ibyte(const char* s, std::size_t n, char c) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    Bytes needle = Bytes::splat(c);
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        uint32_t hits = (ascii_to_lower(Bytes::load(s + i)) == needle).mask();
+        if (hits)
+            return i + count_trailing_zeros(hits);
+    }
+#endif
+
+    for (; i != n; ++i) {
+        if (ascii_to_lower(s[i]) == c)
+            break;
+    }
+
+    return i;
+}
+
+
+
+/**
+ * Offset of the byte at which more than max_code_points code points or more than max_lines lines (newlines + 1)
+ * have begun, counting that byte, or n if the limits are never exceeded.
+ *
+ * Whole blocks are counted with a popcount of the begin and newline masks, only the block in which a limit is
+ * exceeded is walked byte by byte.
+ */
+inline std::size_t truncation_point(const char* s, std::size_t n, std::size_t max_code_points, std::size_t max_lines) noexcept
+{
+    std::size_t i{0};
+    std::size_t code_points{0};
+    std::size_t lines{1};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes b = Bytes::load(s + i);
+        std::size_t block_code_points = popcount(code_point_begin_mask(b));
+        std::size_t block_newlines = popcount((b == Bytes::splat('\n')).mask());
+        if (code_points + block_code_points > max_code_points || lines + block_newlines > max_lines)
+            break;
+
+        code_points += block_code_points;
+        lines += block_newlines;
+    }
+#endif
+
+    for (; i != n; ++i) {
+        auto byte = static_cast<uint8_t>(s[i]);
+        if ((byte & 0xC0) != 0x80 && byte < 0xF8)
+            ++code_points;
+
+        if (byte == '\n')
+            ++lines;
+
+        if (code_points > max_code_points || lines > max_lines)
+            break;
+    }
+
+    return i;
+}
+
+
+
+/**
+ * Number of bytes equal to c.
+ */
+inline std::size_t count_byte(const char* s, std::size_t n, char c) noexcept
+{
+    std::size_t i{0};
+    std::size_t count{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    Bytes needle = Bytes::splat(c);
+    for (; i + Bytes::size <= n; i += Bytes::size)
+        count += popcount((Bytes::load(s + i) == needle).mask());
+#endif
+
+    for (; i != n; ++i)
+        count += s[i] == c;
+
+    return count;
+}
+
+
+
+#ifdef AUDAKI_U8STRING_SIMD
+
+/**
+ * Bytes at or above threshold, which must be at least 0x80. Signed these are the negative bytes from threshold on.
+ */
+inline uint32_t at_least_mask(Bytes b, char threshold) noexcept
+{
+    Bytes negative = b < Bytes::zero();
+    if (threshold == '\x80')
+        return negative.mask();
+
+    return ((b > Bytes::splat(static_cast<char>(threshold - 1))) & negative).mask();
+}
+
+#endif
+
+
+/**
+ * Number of bytes at or above threshold, which must be at least 0x80.
+ */
+inline std::size_t count_bytes_at_least(const char* s, std::size_t n, uint8_t threshold) noexcept
+{
+    std::size_t i{0};
+    std::size_t count{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size)
+        count += popcount(at_least_mask(Bytes::load(s + i), static_cast<char>(threshold)));
+#endif
+
+    for (; i != n; ++i)
+        count += static_cast<uint8_t>(s[i]) >= threshold;
+
+    return count;
+}
+
+
+/**
+ * Position of the first byte at or above threshold, which must be at least 0x80. Returns n if there is none.
+ */
+inline std::size_t find_byte_at_least(const char* s, std::size_t n, uint8_t threshold) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        if (uint32_t hits = at_least_mask(Bytes::load(s + i), static_cast<char>(threshold)))
+            return i + count_trailing_zeros(hits);
+    }
+#endif
+
+    while (i != n && static_cast<uint8_t>(s[i]) < threshold)
+        ++i;
+
+    return i;
+}
+
+
+/**
+ * Number of code points of valid UTF-8 in [s, s + n), i.e. of bytes which aren't continuation bytes. The offset of
+ * every interval-th code point is written to checkpoints, which must have room for n / interval rounded up.
+ *
+ * Whole blocks are counted with a popcount, only blocks containing a checkpoint are looked into.
+ */
+inline std::size_t utf8_count_code_points(const char* s, std::size_t n, std::size_t interval, std::size_t* checkpoints) noexcept
+{
+    std::size_t count{0};
+    std::size_t i{0};
+    std::size_t next_checkpoint{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        // Signed, continuation bytes are the ones below C0
+        uint32_t begins = (Bytes::load(s + i) > Bytes::splat('\xBF')).mask();
+        std::size_t block_count = popcount(begins);
+
+        for (; next_checkpoint < count + block_count; next_checkpoint += interval) {
+            uint32_t rest = begins;
+            for (std::size_t skip = next_checkpoint - count; skip; --skip)
+                rest &= rest - 1;
+
+            *checkpoints++ = i + count_trailing_zeros(rest);
+        }
+
+        count += block_count;
+    }
+#endif
+
+    for (; i != n; ++i) {
+        if ((static_cast<uint8_t>(s[i]) & 0xC0) == 0x80)
+            continue;
+
+        if (count == next_checkpoint) {
+            *checkpoints++ = i;
+            next_checkpoint += interval;
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+
+/**
+ * The bits of little endian code units of unit_size bytes which are set in units from limit on, limit is 0x80
+ * or 0x100.
+ */
+template<std::size_t unit_size, uint32_t limit>
+struct Unit_high_bits {
+    constexpr Unit_high_bits() noexcept: bytes{}
+    {
+        for (std::size_t k{0}; k != sizeof(bytes); ++k)
+            bytes[k] = static_cast<char>(k % unit_size ? 0xFF : limit == 0x80 ? 0x80 : 0x00);
+    }
+
+    char bytes[32];
+};
+
+template<std::size_t unit_size, uint32_t limit>
+inline constexpr Unit_high_bits<unit_size, limit> unit_high_bits{};
+
+
+#if defined(AUDAKI_U8STRING_SIMD) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define AUDAKI_U8STRING_SIMD_UNITS 1
+
+/**
+ * Are all code units of the block of Bytes::size units at s below limit?
+ */
+template<uint32_t limit, class Unit>
+inline bool units_below(const Unit* s) noexcept
+{
+    Bytes mask = Bytes::load(unit_high_bits<sizeof(Unit), limit>.bytes);
+    Bytes bits = Bytes::zero();
+    for (std::size_t k{0}; k != sizeof(Unit); ++k)
+        bits = bits | (Bytes::load(reinterpret_cast<const char*>(s) + k * Bytes::size) & mask);
+
+    return !bits.any();
+}
+
+#endif
+
+
+/**
+ * Number of leading code units below limit in [s, s + n) of UTF-16 or UTF-32 in host byte order.
+ */
+template<uint32_t limit, class Unit>
+inline std::size_t unit_run_length(const Unit* s, std::size_t n) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD_UNITS
+    for (; i + Bytes::size <= n && units_below<limit>(s + i); i += Bytes::size)
+        ;
+#endif
+
+    while (i != n && s[i] < limit)
+        ++i;
+
+    return i;
+}
+
+
+inline std::size_t utf16_latin1_run_length(const char16_t* s, std::size_t n) noexcept
+{
+    return unit_run_length<0x100>(s, n);
+}
+
+
+inline std::size_t utf32_latin1_run_length(const char32_t* s, std::size_t n) noexcept
+{
+    return unit_run_length<0x100>(s, n);
+}
+
+
+/**
+ * Copy the leading code units below 0x80 of [in, in + n) to out as bytes, returns the number of units copied.
+ */
+template<class Unit>
+inline std::size_t narrow_ascii_run(const Unit* in, std::size_t n, char* out) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD_UNITS
+    for (; i + Bytes::size <= n && units_below<0x80>(in + i); i += Bytes::size)
+        Bytes::load_narrowed(in + i).store(out + i);
+#endif
+
+    for (; i != n && in[i] < 0x80; ++i)
+        out[i] = static_cast<char>(in[i]);
+
+    return i;
+}
+
+
+inline std::size_t utf16_ascii_to_utf8_run(const char16_t* in, std::size_t n, char* out) noexcept
+{
+    return narrow_ascii_run(in, n, out);
+}
+
+
+inline std::size_t utf32_ascii_to_utf8_run(const char32_t* in, std::size_t n, char* out) noexcept
+{
+    return narrow_ascii_run(in, n, out);
+}
+
+
+/**
+ * Copy the leading ASCII run of [in, in + n) to out as code units, returns the number of bytes copied.
+ */
+template<class Unit>
+inline std::size_t widen_ascii_run(const char* in, std::size_t n, Unit* out) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD_UNITS
+    for (; i + Bytes::size <= n; i += Bytes::size) {
+        Bytes b = Bytes::load(in + i);
+        if (b.mask())
+            break;
+        b.store_widened(out + i);
+    }
+#endif
+
+    for (; i != n && static_cast<uint8_t>(in[i]) < 0x80; ++i)
+        out[i] = static_cast<Unit>(in[i]);
+
+    return i;
+}
+
+
+inline std::size_t ascii_to_utf16_run(const char* in, std::size_t n, char16_t* out) noexcept
+{
+    return widen_ascii_run(in, n, out);
+}
+
+
+inline std::size_t ascii_to_utf32_run(const char* in, std::size_t n, char32_t* out) noexcept
+{
+    return widen_ascii_run(in, n, out);
+}
+
+
+
+
+#ifdef AUDAKI_U8STRING_SIMD_LOOKUP
+
+/*
+ * Lookup algorithm by Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+ *
+ * Every error of a two byte window can be identified by the high nibble of the first byte, the low nibble
+ * of the first byte and the high nibble of the second byte. Each nibble selects a bit set of the errors it
+ * can take part in, the window is invalid if all three sets share a bit. Missing or excess continuation
+ * bytes of three and four byte sequences are checked separately by looking two and three bytes back.
+ */
+namespace utf8_lookup {
+
+constexpr uint8_t too_short = 1 << 0;      // 11______ 0_______ or 11______ 11______
+constexpr uint8_t too_long = 1 << 1;       // 0_______ 10______
+constexpr uint8_t overlong_3 = 1 << 2;     // 11100000 100_____
+constexpr uint8_t too_large = 1 << 3;      // 11110100 1001____ and above
+constexpr uint8_t surrogate = 1 << 4;      // 11101101 101_____
+constexpr uint8_t overlong_2 = 1 << 5;     // 1100000_ 10______
+constexpr uint8_t too_large_1000 = 1 << 6; // 11110101 1000____ and above
+constexpr uint8_t overlong_4 = 1 << 6;     // 11110000 1000____
+constexpr uint8_t two_conts = 1 << 7;      // 10______ 10______
+constexpr uint8_t carry = too_short | too_long | two_conts;
+
+constexpr uint8_t byte_1_high[16] = {
+    too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+    two_conts, two_conts, two_conts, two_conts,
+    too_short | overlong_2,
+    too_short,
+    too_short | overlong_3 | surrogate,
+    too_short | too_large | too_large_1000 | overlong_4
+};
+
+constexpr uint8_t byte_1_low[16] = {
+    carry | overlong_3 | overlong_2 | overlong_4,
+    carry | overlong_2,
+    carry,
+    carry,
+    carry | too_large,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000 | surrogate,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000
+};
+
+constexpr uint8_t byte_2_high[16] = {
+    too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_short, too_short, too_short, too_short
+};
+
+
+inline Bytes check_block(Bytes input, Bytes previous) noexcept
+{
+    Bytes prev1 = input.prev<1>(previous);
+    Bytes special_cases =
+            prev1.high_nibbles().lookup16(byte_1_high) &
+            prev1.low_nibbles().lookup16(byte_1_low) &
+            input.high_nibbles().lookup16(byte_2_high);
+
+    // Only 111_____ and 1111____ two and three bytes back keep the high bit, these must be followed by continuations
+    Bytes is_third_byte = input.prev<2>(previous).saturating_sub(Bytes::splat(static_cast<char>(0xE0 - 0x80)));
+    Bytes is_fourth_byte = input.prev<3>(previous).saturating_sub(Bytes::splat(static_cast<char>(0xF0 - 0x80)));
+    Bytes must_be_continuation = (is_third_byte | is_fourth_byte) & Bytes::splat(static_cast<char>(0x80));
+
+    return must_be_continuation ^ special_cases;
+}
+
+
+/**
+ * Non-zero where a sequence at the end of the block still needs continuation bytes.
+ */
+inline Bytes incomplete_tail(Bytes input) noexcept
+{
+    alignas(32) static constexpr char max_values[64] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1)
+    };
+
+    return input.saturating_sub(Bytes::load(max_values + 64 - Bytes::size));
+}
+
+}
+
+#endif
+
+
+/**
+ * Offset at which the vector checks of UTF-8 in [data, data + size) stopped: the first block they flag, or the
+ * end of the last whole block. Errors flagged at a block can begin up to three bytes before it, the exact offset
+ * is left to the scalar validator.
+ */
+inline std::size_t utf8_checked_length(const char* data, std::size_t size) noexcept
+{
+    std::size_t pos{0};
+
+#ifdef AUDAKI_U8STRING_SIMD_LOOKUP
+    Bytes previous = Bytes::zero();
+    Bytes previous_incomplete = Bytes::zero();
+
+    for (; pos + Bytes::size <= size; pos += Bytes::size) {
+        Bytes input = Bytes::load(data + pos);
+
+        // An ASCII block is only an error if the previous block ended in the middle of a sequence
+        Bytes error = previous_incomplete;
+        if (input.mask()) {
+            error = utf8_lookup::check_block(input, previous);
+            previous_incomplete = utf8_lookup::incomplete_tail(input);
+        }
+        else {
+            previous_incomplete = Bytes::zero();
+        }
+
+        if (error.any())
+            return pos;
+
+        previous = input;
+    }
+#else
+    (void)data;
+    (void)size;
+#endif
+
+    return pos;
+}
+
+
+
+/**
+ * Position of the first occurrence of the needle of m >= 2 bytes in [h, h + n), or std::size_t(-1) like npos.
+ * Candidates are the positions where both the first and the last byte of the needle match.
+ */
+inline std::size_t find_short_needle(const char* h, std::size_t n, const char* needle, std::size_t m) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    Bytes first = Bytes::splat(needle[0]);
+    Bytes last = Bytes::splat(needle[m - 1]);
+
+    for (; i + m - 1 + Bytes::size <= n; i += Bytes::size) {
+        uint32_t candidates = ((Bytes::load(h + i) == first) & (Bytes::load(h + i + m - 1) == last)).mask();
+        while (candidates) {
+            std::size_t candidate = i + count_trailing_zeros(candidates);
+            if (std::memcmp(h + candidate + 1, needle + 1, m - 2) == 0)
+                return candidate;
+
+            candidates &= candidates - 1;
+        }
+    }
+#endif
+
+    for (; i + m <= n; ++i) {
+        const void* found = std::memchr(h + i, needle[0], n - m + 1 - i);
+        if (!found)
+            break;
+
+        i = static_cast<std::size_t>(static_cast<const char*>(found) - h);
+        if (h[i + m - 1] == needle[m - 1] && std::memcmp(h + i + 1, needle + 1, m - 2) == 0)
+            return i;
+    }
+
+    return static_cast<std::size_t>(-1);
+}
+
+
+
+#ifdef AUDAKI_U8STRING_SIMD
+
+constexpr uint32_t all_bytes_mask = (Bytes::size == 32) ? 0xFFFF'FFFFu : 0xFFFFu;
+
+
+/**
+ * The members of a block as found by for_each_class_block, or the other bytes.
+ */
+template<bool is_member>
+inline uint32_t class_hits(uint32_t members) noexcept
+{
+    return is_member ? members : ~members & all_bytes_mask;
+}
+
+
+/**
+ * Calls on_block(position, members) for the whole blocks of [s, s + n), from the front or (backwards) from the
+ * back, until it returns true. members has one bit per byte of the block, set for the members of the class.
+ * Returns the bytes left over or 0 if on_block returned true.
+ */
+template<bool backwards, class On_block>
+inline std::size_t for_each_class_block(const char* s, std::size_t n, const Class_tables& tables, On_block on_block) noexcept
+{
+    std::size_t blocks = n - n % Bytes::size;
+    auto scan = [&](auto member_mask) {
+        for (std::size_t k{0}; k != blocks; k += Bytes::size) {
+            std::size_t position = backwards ? n - k - Bytes::size : k;
+            if (on_block(position, member_mask(Bytes::load(s + position))))
+                return true;
+        }
+        return false;
+    };
+
+#ifdef AUDAKI_U8STRING_SIMD_LOOKUP
+    // Shufti: the low and the high nibble each select a set of buckets, members share a bucket in both
+    if (tables.low_nibbles) {
+        return scan([&](Bytes b) {
+            Bytes buckets = b.low_nibbles().lookup16(tables.low_nibbles) & b.high_nibbles().lookup16(tables.high_nibbles);
+            return ~(buckets == Bytes::zero()).mask() & all_bytes_mask;
+        }) ? 0 : n - blocks;
+    }
+#endif
+
+    if (tables.bytes) {
+        return scan([&](Bytes b) {
+            Bytes members = Bytes::zero();
+            for (std::size_t k{0}; k != tables.byte_count; ++k)
+                members = members | (b == Bytes::splat(tables.bytes[k]));
+            return members.mask();
+        }) ? 0 : n - blocks;
+    }
+
+    return n;
+}
+
+#endif
+
+
+inline bool is_class_member(const Class_tables& tables, char c) noexcept
+{
+    auto u = static_cast<uint8_t>(c);
+    return (tables.bitmap[u >> 6] >> (u & 63)) & 1;
+}
+
+
+/**
+ * Position of the first byte in [s, s + n) which is (is_member) or isn't a member of the class, n if there is none.
+ */
+template<bool is_member>
+inline std::size_t find_first_in_class(const char* s, std::size_t n, const Class_tables& tables) noexcept
+{
+    std::size_t i{0};
+
+#ifdef AUDAKI_U8STRING_SIMD
+    std::size_t found = n;
+    std::size_t left = for_each_class_block<false>(s, n, tables, [&](std::size_t position, uint32_t members) {
+        uint32_t hits = class_hits<is_member>(members);
+        if (hits)
+            found = position + count_trailing_zeros(hits);
+        return hits != 0;
+    });
+    if (found != n)
+        return found;
+
+    i = n - left;
+#endif
+
+    while (i != n && is_class_member(tables, s[i]) != is_member)
+        ++i;
+
+    return i;
+}
+
+
+/**
+ * Position of the last byte in [s, s + n) which is (is_member) or isn't a member of the class, n if there is none.
+ */
+template<bool is_member>
+inline std::size_t find_last_in_class(const char* s, std::size_t n, const Class_tables& tables) noexcept
+{
+    std::size_t end = n;
+
+#ifdef AUDAKI_U8STRING_SIMD
+    std::size_t found = n;
+    std::size_t left = for_each_class_block<true>(s, n, tables, [&](std::size_t position, uint32_t members) {
+        uint32_t hits = class_hits<is_member>(members);
+        if (hits)
+            found = position + 31 - count_leading_zeros(hits);
+        return hits != 0;
+    });
+    if (found != n)
+        return found;
+
+    end = left;
+#endif
+
+    while (end--) {
+        if (is_class_member(tables, s[end]) == is_member)
+            return end;
+    }
+
+    return n;
+}
+
+
+inline std::size_t find_first_of_class(const char* s, std::size_t n, const Class_tables& tables) noexcept
+{
+    return find_first_in_class<true>(s, n, tables);
+}
+
+
+inline std::size_t find_first_not_of_class(const char* s, std::size_t n, const Class_tables& tables) noexcept
+{
+    return find_first_in_class<false>(s, n, tables);
+}
+
+
+inline std::size_t find_last_of_class(const char* s, std::size_t n, const Class_tables& tables) noexcept
+{
+    return find_last_in_class<true>(s, n, tables);
+}
+
+
+inline std::size_t find_last_not_of_class(const char* s, std::size_t n, const Class_tables& tables) noexcept
+{
+    return find_last_in_class<false>(s, n, tables);
+}
+
+
+}
+}
@@ -0,0 +1,10 @@
+#include "audaki/simd_kernels.h"
+
+
+
+#ifdef AUDAKI_U8STRING_DISPATCH_X86
+
+// Compiled with -mavx2 -mpopcnt -mno-avx512f, see CMakeLists.txt
+const u8_simd::Kernels u8_simd::avx2_kernels = u8_simd::make_kernels();
+
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "audaki/simd.h"
+
+#include <atomic>
+
+
+
+/**
+ * Runtime dispatch of the byte kernels.
+ *
+ * simd_<level>.cpp compile simd.h once per instruction set level into a table of the kernels, the library calls
+ * them through the table chosen on first use by the CPU features and AUDAKI_U8STRING_SIMD_LEVEL, see
+ * set_simd_level(). Kernels which aren't in the table run at the level the library is compiled for.
+ */
+namespace u8_simd {
+
+
+struct Kernels {
+    std::size_t (*ascii_run_length)(const char* s, std::size_t n) noexcept;
+    std::size_t (*common_prefix_length)(const char* a, const char* b, std::size_t n) noexcept;
+    std::size_t (*ascii_iequal_run_length)(const char* a, const char* b, std::size_t n) noexcept;
+    std::size_t (*ascii_to_lower_run)(const char* in, std::size_t n, char* out) noexcept;
+    std::size_t (*ascii_to_upper_run)(const char* in, std::size_t n, char* out) noexcept;
+    std::size_t (*find_ascii_ibyte)(const char* s, std::size_t n, char c) noexcept;
+    std::size_t (*find_ascii_ibytes_or_non_ascii)(const char* s, std::size_t n, const char* set, std::size_t set_size) noexcept;
+    std::size_t (*find_short_needle)(const char* h, std::size_t n, const char* needle, std::size_t m) noexcept;
+    std::size_t (*utf8_checked_length)(const char* data, std::size_t size) noexcept;
+    std::size_t (*truncation_point)(const char* s, std::size_t n, std::size_t max_code_points, std::size_t max_lines) noexcept;
+    std::size_t (*count_byte)(const char* s, std::size_t n, char c) noexcept;
+    std::size_t (*count_bytes_at_least)(const char* s, std::size_t n, uint8_t threshold) noexcept;
+    std::size_t (*find_byte_at_least)(const char* s, std::size_t n, uint8_t threshold) noexcept;
+    std::size_t (*utf8_count_code_points)(const char* s, std::size_t n, std::size_t interval, std::size_t* checkpoints) noexcept;
+    std::size_t (*utf16_latin1_run_length)(const char16_t* s, std::size_t n) noexcept;
+    std::size_t (*utf32_latin1_run_length)(const char32_t* s, std::size_t n) noexcept;
+    std::size_t (*utf16_ascii_to_utf8_run)(const char16_t* in, std::size_t n, char* out) noexcept;
+    std::size_t (*utf32_ascii_to_utf8_run)(const char32_t* in, std::size_t n, char* out) noexcept;
+    std::size_t (*ascii_to_utf16_run)(const char* in, std::size_t n, char16_t* out) noexcept;
+    std::size_t (*ascii_to_utf32_run)(const char* in, std::size_t n, char32_t* out) noexcept;
+    std::size_t (*find_first_of_class)(const char* s, std::size_t n, const Class_tables& tables) noexcept;
+    std::size_t (*find_first_not_of_class)(const char* s, std::size_t n, const Class_tables& tables) noexcept;
+    std::size_t (*find_last_of_class)(const char* s, std::size_t n, const Class_tables& tables) noexcept;
+    std::size_t (*find_last_not_of_class)(const char* s, std::size_t n, const Class_tables& tables) noexcept;
+};
+
+
+inline namespace AUDAKI_U8STRING_SIMD_NAMESPACE {
+
+/**
+ * The kernels of the level this translation unit is compiled for.
+ */
+constexpr Kernels make_kernels() noexcept
+{
+    return {
+        &ascii_run_length,
+        &common_prefix_length,
+        &ascii_iequal_run_length,
+        &ascii_to_lower_run,
+        &ascii_to_upper_run,
+        &find_ascii_ibyte,
+        &find_ascii_ibytes_or_non_ascii,
+        &find_short_needle,
+        &utf8_checked_length,
+        &truncation_point,
+        &count_byte,
+        &count_bytes_at_least,
+        &find_byte_at_least,
+        &utf8_count_code_points,
+        &utf16_latin1_run_length,
+        &utf32_latin1_run_length,
+        &utf16_ascii_to_utf8_run,
+        &utf32_ascii_to_utf8_run,
+        &ascii_to_utf16_run,
+        &ascii_to_utf32_run,
+        &find_first_of_class,
+        &find_first_not_of_class,
+        &find_last_of_class,
+        &find_last_not_of_class};
+}
+
+}
+
+
+extern const Kernels swar_kernels;
+
+#ifdef AUDAKI_U8STRING_DISPATCH_X86
+extern const Kernels sse2_kernels;
+extern const Kernels sse42_kernels;
+extern const Kernels avx2_kernels;
+#endif
+
+
+extern std::atomic<const Kernels*> active_kernels;
+
+/**
+ * Chooses the kernels on first use.
+ */
+const Kernels& select_kernels() noexcept;
+
+inline const Kernels& kernels() noexcept
+{
+    const Kernels* active = active_kernels.load(std::memory_order_acquire);
+    return active ? *active : select_kernels();
+}
+
+
+}
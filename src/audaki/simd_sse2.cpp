@@ -0,0 +1,10 @@
+#include "audaki/simd_kernels.h"
+
+
+
+#ifdef AUDAKI_U8STRING_DISPATCH_X86
+
+// Compiled with -msse2 -mno-sse3, see CMakeLists.txt
+const u8_simd::Kernels u8_simd::sse2_kernels = u8_simd::make_kernels();
+
+#endif
@@ -0,0 +1,10 @@
+#include "audaki/simd_kernels.h"
+
+
+
+#ifdef AUDAKI_U8STRING_DISPATCH_X86
+
+// Compiled with -msse4.2 -mpopcnt -mno-avx, see CMakeLists.txt
+const u8_simd::Kernels u8_simd::sse42_kernels = u8_simd::make_kernels();
+
+#endif
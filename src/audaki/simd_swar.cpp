@@ -0,0 +1,8 @@
+// Kernels without vector instructions, available on every CPU
+#define AUDAKI_U8STRING_NO_SIMD 1
+
+#include "audaki/simd_kernels.h"
+
+
+
+const u8_simd::Kernels u8_simd::swar_kernels = u8_simd::make_kernels();
@@ -0,0 +1,128 @@
+#include "audaki/u8string.h"
+
+
+
+namespace {
+
+/**
+ * Size of the first n code points of v, all of v if it has fewer.
+ */
+std::size_t code_point_prefix_bytes(std::string_view v, std::size_t n) noexcept
+{
+    Utf8_view view{v};
+    auto it = view.begin();
+    for (auto end = view.end(); n && it != end; --n)
+        ++it;
+
+    return it.position();
+}
+
+
+/**
+ * Size of the last n code points of v, all of v if it has fewer.
+ */
+std::size_t code_point_suffix_bytes(std::string_view v, std::size_t n) noexcept
+{
+    Utf8_view view{v};
+    auto it = view.end();
+    for (; n && it.position() != 0; --n)
+        --it;
+
+    return v.size() - it.position();
+}
+
+}
+
+
+
+bool Utf8_stream_validator::feed(std::string_view chunk) noexcept
+{
+    if (error_offset_ == std::string_view::npos)
+        decoder_.feed(chunk, [this](std::string_view piece) { validate(piece); });
+
+    return error_offset_ == std::string_view::npos;
+}
+
+
+Utf8_validation Utf8_stream_validator::finish() noexcept
+{
+    decoder_.finish([this](std::string_view piece) { validate(piece); });
+    return {error_offset_};
+}
+
+
+void Utf8_stream_validator::validate(std::string_view piece) noexcept
+{
+    if (error_offset_ != std::string_view::npos)
+        return;
+
+    auto validation = validate_utf8(piece);
+    if (!validation)
+        error_offset_ = offset_ + validation.error_offset;
+
+    offset_ += piece.size();
+}
+
+
+
+Icase_stream_matcher::Icase_stream_matcher(Icase_pattern pattern):
+    pattern_{std::move(pattern)},
+    overlap_code_points_{0},
+    is_found_{pattern_.folded_needle().empty()}
+{
+    // The folded needle is valid UTF-8, one code point per byte which isn't a continuation byte
+    for (char c : pattern_.folded_needle())
+        overlap_code_points_ += (static_cast<uint8_t>(c) & 0xC0) != 0x80;
+
+    if (overlap_code_points_)
+        --overlap_code_points_;
+}
+
+
+bool Icase_stream_matcher::feed(std::string_view chunk)
+{
+    if (!is_found_)
+        decoder_.feed(chunk, [this](std::string_view piece) { search(piece); });
+
+    return is_found_;
+}
+
+
+bool Icase_stream_matcher::finish()
+{
+    decoder_.finish([this](std::string_view piece) { search(piece); });
+    return is_found_;
+}
+
+
+void Icase_stream_matcher::search(std::string_view piece)
+{
+    if (is_found_)
+        return;
+
+    // Matches across the boundary start in the kept code points and end in the first ones of piece
+    if (!carry_.empty()) {
+        seam_.assign(carry_);
+        seam_.append(piece.substr(0, code_point_prefix_bytes(piece, overlap_code_points_)));
+        if (pattern_.contains(seam_)) {
+            is_found_ = true;
+            return;
+        }
+    }
+
+    if (pattern_.contains(piece)) {
+        is_found_ = true;
+        return;
+    }
+
+    // Only adjacent bytes may be joined, a cut off sequence followed by unrelated continuation bytes would decode
+    // differently. So the carry grows by whole pieces only and is replaced by the end of longer ones.
+    std::size_t suffix = code_point_suffix_bytes(piece, overlap_code_points_);
+    if (suffix != piece.size()) {
+        carry_.assign(piece.substr(piece.size() - suffix));
+        return;
+    }
+
+    carry_.append(piece);
+    carry_.erase(0, carry_.size() - code_point_suffix_bytes(carry_, overlap_code_points_));
+}
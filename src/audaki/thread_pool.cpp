@@ -0,0 +1,213 @@
+#include "audaki/u8string.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+
+
+namespace {
+
+/**
+ * The task indices [begin, end) a thread has left, packed into one word so the owner taking from the front and
+ * thieves taking from the back agree by compare and swap.
+ */
+struct alignas(64) Task_range {
+    std::atomic<uint64_t> bounds{0};
+
+    static uint64_t pack(uint64_t begin, uint64_t end) noexcept
+    {
+        return begin | (end << 32);
+    }
+
+    static uint64_t begin(uint64_t bounds) noexcept
+    {
+        return bounds & 0xFFFF'FFFFu;
+    }
+
+    static uint64_t end(uint64_t bounds) noexcept
+    {
+        return bounds >> 32;
+    }
+};
+
+
+thread_local const void* current_pool{nullptr};
+
+}
+
+
+
+struct Thread_pool::State {
+
+    explicit State(std::size_t thread_count): ranges(std::max<std::size_t>(thread_count, 1))
+    {
+    }
+
+    /**
+     * Run tasks of the current batch as the thread in slot, until there are none left to take or steal or a
+     * task threw. The first exception is kept for run() to rethrow.
+     */
+    void work(std::size_t slot)
+    {
+        auto& own = ranges[slot].bounds;
+        while (true) {
+            uint64_t bounds = own.load();
+            while (Task_range::begin(bounds) < Task_range::end(bounds) && !has_failed.load(std::memory_order_relaxed)) {
+                uint64_t task_index = Task_range::begin(bounds);
+                if (own.compare_exchange_weak(bounds, Task_range::pack(task_index + 1, Task_range::end(bounds)))) {
+                    try {
+                        (*task)(task_index);
+                    } catch (...) {
+                        fail(std::current_exception());
+                        return;
+                    }
+                }
+                bounds = own.load();
+            }
+
+            if (has_failed.load(std::memory_order_relaxed) || !steal(slot))
+                return;
+        }
+    }
+
+    void fail(std::exception_ptr exception) noexcept
+    {
+        std::lock_guard lock{mutex};
+        if (!first_exception)
+            first_exception = std::move(exception);
+        has_failed.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * Move the back half of another thread's range into the own one, which is empty.
+     */
+    bool steal(std::size_t slot) noexcept
+    {
+        for (std::size_t i{1}; i != ranges.size(); ++i) {
+            auto& victim = ranges[(slot + i) % ranges.size()].bounds;
+            uint64_t bounds = victim.load();
+            while (Task_range::begin(bounds) < Task_range::end(bounds)) {
+                uint64_t begin = Task_range::begin(bounds);
+                uint64_t end = Task_range::end(bounds);
+                uint64_t split = end - (end - begin + 1) / 2;
+                if (victim.compare_exchange_weak(bounds, Task_range::pack(begin, split))) {
+                    ranges[slot].bounds.store(Task_range::pack(split, end));
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void worker(std::size_t slot)
+    {
+        current_pool = this;
+        uint64_t seen_generation{0};
+
+        while (true) {
+            std::unique_lock lock{mutex};
+            wake.wait(lock, [&] { return is_stopping || generation != seen_generation; });
+            if (is_stopping)
+                return;
+
+            seen_generation = generation;
+            lock.unlock();
+
+            work(slot);
+
+            lock.lock();
+            if (--active_workers == 0)
+                done.notify_one();
+        }
+    }
+
+    std::vector<Task_range> ranges;
+    std::vector<std::thread> workers;
+
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(std::size_t)>* task{nullptr};
+    uint64_t generation{0};
+    std::size_t active_workers{0};
+    bool is_stopping{false};
+    std::atomic<bool> has_failed{false};
+    std::exception_ptr first_exception;
+};
+
+
+
+Thread_pool::Thread_pool(std::size_t thread_count): state_{std::make_unique<State>(thread_count)}
+{
+    for (std::size_t slot{1}; slot < state_->ranges.size(); ++slot)
+        state_->workers.emplace_back([state = state_.get(), slot] { state->worker(slot); });
+}
+
+
+Thread_pool::~Thread_pool()
+{
+    {
+        std::lock_guard lock{state_->mutex};
+        state_->is_stopping = true;
+    }
+    state_->wake.notify_all();
+
+    for (auto& worker : state_->workers)
+        worker.join();
+}
+
+
+void Thread_pool::run(std::size_t task_count, const std::function<void(std::size_t)>& task)
+{
+    // Without other threads, for single tasks and for batches started by tasks of this pool
+    if (state_->workers.empty() || task_count <= 1 || current_pool == state_.get()) {
+        for (std::size_t i{0}; i != task_count; ++i)
+            task(i);
+        return;
+    }
+
+    assert(task_count < (uint64_t{1} << 32));
+
+    std::lock_guard run_lock{state_->run_mutex};
+    std::size_t thread_count = state_->ranges.size();
+    for (std::size_t slot{0}; slot != thread_count; ++slot)
+        state_->ranges[slot].bounds.store(Task_range::pack(task_count * slot / thread_count, task_count * (slot + 1) / thread_count));
+
+    {
+        std::lock_guard lock{state_->mutex};
+        state_->task = &task;
+        state_->has_failed.store(false, std::memory_order_relaxed);
+        state_->active_workers = state_->workers.size();
+        ++state_->generation;
+    }
+    state_->wake.notify_all();
+
+    const void* previous_pool = current_pool;
+    current_pool = state_.get();
+    state_->work(0);
+    current_pool = previous_pool;
+
+    std::unique_lock lock{state_->mutex};
+    state_->done.wait(lock, [&] { return state_->active_workers == 0; });
+    state_->task = nullptr;
+    if (auto exception = std::exchange(state_->first_exception, nullptr))
+        std::rethrow_exception(exception);
+}
+
+
+std::size_t Thread_pool::thread_count() const noexcept
+{
+    return state_->ranges.size();
+}
+
+
+Thread_pool& Thread_pool::shared()
+{
+    static Thread_pool pool{std::max(1u, std::thread::hardware_concurrency())};
+    return pool;
+}
@@ -0,0 +1,435 @@
+#include "audaki/u8string.h"
+
+#include "audaki/icase_search.h"
+#include "audaki/simd_kernels.h"
+
+
+
+namespace {
+
+/**
+ * Windows-1252 code points of 0x80 to 0x9F, the unassigned bytes keep their value.
+ */
+constexpr std::array<char16_t, 32> windows1252_high{
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool is_big_endian = true;
+#else
+constexpr bool is_big_endian = false;
+#endif
+
+
+/**
+ * A UTF-16LE code unit in host byte order and back. The unit kernels work in host byte order, so big endian hosts
+ * convert UTF-16 one code unit at a time.
+ */
+char16_t utf16le_unit(char16_t u) noexcept
+{
+    if constexpr (is_big_endian)
+        return static_cast<char16_t>(__builtin_bswap16(u));
+    return u;
+}
+
+
+bool is_high_surrogate(uint32_t u) noexcept
+{
+    return u >= 0xD800 && u <= 0xDBFF;
+}
+
+
+bool is_low_surrogate(uint32_t u) noexcept
+{
+    return u >= 0xDC00 && u <= 0xDFFF;
+}
+
+
+/**
+ * Encode c to out, which only needs room for the encoding as outputs are sized exactly.
+ */
+std::size_t encode_utf8(uint32_t c, char* out) noexcept
+{
+    auto utf8 = Unicode_code_point{c}.to_utf8();
+    std::size_t size = u8_search::utf8_byte_count(Unicode_code_point{c});
+    std::memcpy(out, utf8.data(), size);
+    return size;
+}
+
+
+/**
+ * Number of code points of UTF-8, every byte which isn't a continuation byte begins one.
+ */
+std::size_t code_point_count(std::string_view v) noexcept
+{
+    const auto& kernels = u8_simd::kernels();
+    return v.size() - kernels.count_bytes_at_least(v.data(), v.size(), 0x80) + kernels.count_bytes_at_least(v.data(), v.size(), 0xC0);
+}
+
+
+/**
+ * Length of the valid UTF-8 prefix of v.
+ */
+std::size_t valid_prefix_size(std::string_view v) noexcept
+{
+    std::size_t error_offset = validate_utf8(v).error_offset;
+    return error_offset == std::string_view::npos ? v.size() : error_offset;
+}
+
+
+/**
+ * Convert the valid UTF-8 in v to UTF-16 or UTF-32 in host byte order, ASCII runs are widened without decoding.
+ */
+template<class Unit>
+std::size_t widen_valid_utf8(std::string_view v, Unit* out) noexcept
+{
+    const auto& kernels = u8_simd::kernels();
+    auto ascii_to_units_run = [&kernels] {
+        if constexpr (sizeof(Unit) == 2)
+            return kernels.ascii_to_utf16_run;
+        else
+            return kernels.ascii_to_utf32_run;
+    }();
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != v.size()) {
+        std::size_t run = ascii_to_units_run(v.data() + pos, v.size() - pos, out + size);
+        pos += run;
+        size += run;
+        if (pos == v.size())
+            break;
+
+        auto decoded = decode_valid_utf8(v.data() + pos);
+        uint32_t c = decoded.code_point.v_;
+        pos += decoded.byte_count;
+
+        if constexpr (sizeof(Unit) == 2) {
+            if (c > 0xFFFF) {
+                out[size++] = static_cast<Unit>(0xD800 + ((c - 0x10000) >> 10));
+                out[size++] = static_cast<Unit>(0xDC00 + (c & 0x3FF));
+                continue;
+            }
+        }
+
+        out[size++] = static_cast<Unit>(c);
+    }
+
+    return size;
+}
+
+
+/**
+ * Convert to a string of the precomputed size, which is shrunk to the written size.
+ */
+template<class String, class Input, class Unit>
+std::optional<String> convert_to_string(Input input, std::size_t size, Transcode_result (*convert)(Input, Unit*) noexcept)
+{
+    String out(size, Unit{0});
+    auto result = convert(input, out.data());
+    if (!result)
+        return std::nullopt;
+
+    out.resize(result.written);
+    return out;
+}
+
+}
+
+
+
+std::size_t latin1_to_utf8_size(std::string_view latin1) noexcept
+{
+    return latin1.size() + u8_simd::kernels().count_bytes_at_least(latin1.data(), latin1.size(), 0x80);
+}
+
+
+std::size_t latin1_to_utf8(std::string_view latin1, char* out) noexcept
+{
+    auto ascii_run_length = u8_simd::kernels().ascii_run_length;
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != latin1.size()) {
+        std::size_t run = ascii_run_length(latin1.data() + pos, latin1.size() - pos);
+        std::memcpy(out + size, latin1.data() + pos, run);
+        pos += run;
+        size += run;
+
+        for (; pos != latin1.size() && static_cast<uint8_t>(latin1[pos]) >= 0x80; ++pos) {
+            auto byte = static_cast<uint8_t>(latin1[pos]);
+            out[size++] = static_cast<char>(0xC0 | (byte >> 6));
+            out[size++] = static_cast<char>(0x80 | (byte & 0x3F));
+        }
+    }
+
+    return size;
+}
+
+
+std::string latin1_to_utf8(std::string_view latin1)
+{
+    std::string out(latin1_to_utf8_size(latin1), '\0');
+    latin1_to_utf8(latin1, out.data());
+    return out;
+}
+
+
+
+std::size_t windows1252_to_utf8_size(std::string_view windows1252) noexcept
+{
+    const auto& kernels = u8_simd::kernels();
+    const char* data = windows1252.data();
+    std::size_t n = windows1252.size();
+    std::size_t non_ascii = kernels.count_bytes_at_least(data, n, 0x80);
+    std::size_t size = n + non_ascii;
+
+    // Bytes from 0x80 to 0x9F may map to three byte sequences
+    if (non_ascii == kernels.count_bytes_at_least(data, n, 0xA0))
+        return size;
+
+    for (std::size_t pos{0}; (pos += kernels.find_byte_at_least(data + pos, n - pos, 0x80)) != n; ++pos) {
+        auto byte = static_cast<uint8_t>(data[pos]);
+        size += byte < 0xA0 && windows1252_high[byte - 0x80] >= 0x800;
+    }
+
+    return size;
+}
+
+
+std::size_t windows1252_to_utf8(std::string_view windows1252, char* out) noexcept
+{
+    auto ascii_run_length = u8_simd::kernels().ascii_run_length;
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != windows1252.size()) {
+        std::size_t run = ascii_run_length(windows1252.data() + pos, windows1252.size() - pos);
+        std::memcpy(out + size, windows1252.data() + pos, run);
+        pos += run;
+        size += run;
+
+        for (; pos != windows1252.size() && static_cast<uint8_t>(windows1252[pos]) >= 0x80; ++pos) {
+            auto byte = static_cast<uint8_t>(windows1252[pos]);
+            uint32_t c = byte < 0xA0 ? windows1252_high[byte - 0x80] : byte;
+            size += encode_utf8(c, out + size);
+        }
+    }
+
+    return size;
+}
+
+
+std::string windows1252_to_utf8(std::string_view windows1252)
+{
+    std::string out(windows1252_to_utf8_size(windows1252), '\0');
+    windows1252_to_utf8(windows1252, out.data());
+    return out;
+}
+
+
+
+bool fits_latin1(Utf8_view v) noexcept
+{
+    // Valid UTF-8 of code points above U+00FF is exactly the one with lead bytes from C4 on
+    return validate_utf8(v.v_) && u8_simd::kernels().find_byte_at_least(v.v_.data(), v.v_.size(), 0xC4) == v.v_.size();
+}
+
+
+bool fits_latin1(std::u16string_view utf16) noexcept
+{
+    if constexpr (is_big_endian) {
+        char16_t bits{0};
+        for (char16_t u : utf16)
+            bits |= utf16le_unit(u);
+
+        return bits <= 0xFF;
+    }
+
+    return u8_simd::kernels().utf16_latin1_run_length(utf16.data(), utf16.size()) == utf16.size();
+}
+
+
+bool fits_latin1(std::u32string_view utf32) noexcept
+{
+    return u8_simd::kernels().utf32_latin1_run_length(utf32.data(), utf32.size()) == utf32.size();
+}
+
+
+std::size_t utf8_to_latin1_size(Utf8_view v) noexcept
+{
+    return code_point_count(v.v_);
+}
+
+
+Transcode_result utf8_to_latin1(Utf8_view v, char* out) noexcept
+{
+    std::string_view s = v.v_;
+    std::size_t end = valid_prefix_size(s);
+    end = u8_simd::kernels().find_byte_at_least(s.data(), end, 0xC4);
+
+    // Up to end there are only ASCII bytes and two byte sequences with lead byte C2 or C3
+    auto ascii_run_length = u8_simd::kernels().ascii_run_length;
+    std::size_t size{0};
+    std::size_t pos{0};
+    while (pos != end) {
+        std::size_t run = ascii_run_length(s.data() + pos, end - pos);
+        std::memcpy(out + size, s.data() + pos, run);
+        pos += run;
+        size += run;
+
+        for (; pos != end && static_cast<uint8_t>(s[pos]) >= 0x80; pos += 2)
+            out[size++] = static_cast<char>(((static_cast<uint8_t>(s[pos]) & 0x03) << 6) | (static_cast<uint8_t>(s[pos + 1]) & 0x3F));
+    }
+
+    return {end == s.size() ? std::string_view::npos : end, size};
+}
+
+
+std::optional<std::string> utf8_to_latin1(Utf8_view v)
+{
+    return convert_to_string<std::string>(v, utf8_to_latin1_size(v), &utf8_to_latin1);
+}
+
+
+
+std::size_t utf8_to_utf16_size(Utf8_view v) noexcept
+{
+    // Code points from U+10000 on, which have four byte sequences, take two code units
+    return code_point_count(v.v_) + u8_simd::kernels().count_bytes_at_least(v.v_.data(), v.v_.size(), 0xF0);
+}
+
+
+Transcode_result utf8_to_utf16(Utf8_view v, char16_t* out) noexcept
+{
+    std::size_t end = valid_prefix_size(v.v_);
+    std::size_t size = widen_valid_utf8(v.v_.substr(0, end), out);
+    if constexpr (is_big_endian) {
+        for (std::size_t i{0}; i != size; ++i)
+            out[i] = utf16le_unit(out[i]);
+    }
+
+    return {end == v.v_.size() ? std::string_view::npos : end, size};
+}
+
+
+std::optional<std::u16string> utf8_to_utf16(Utf8_view v)
+{
+    return convert_to_string<std::u16string>(v, utf8_to_utf16_size(v), &utf8_to_utf16);
+}
+
+
+std::size_t utf16_to_utf8_size(std::u16string_view utf16) noexcept
+{
+    // A surrogate pair is a four byte sequence, two bytes per code unit
+    std::size_t size{0};
+    for (char16_t unit : utf16) {
+        char16_t u = utf16le_unit(unit);
+        size += u < 0x80 ? 1 : u < 0x800 || (u >= 0xD800 && u <= 0xDFFF) ? 2 : 3;
+    }
+
+    return size;
+}
+
+
+Transcode_result utf16_to_utf8(std::u16string_view utf16, char* out) noexcept
+{
+    auto ascii_to_utf8_run = u8_simd::kernels().utf16_ascii_to_utf8_run;
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != utf16.size()) {
+        if constexpr (!is_big_endian) {
+            std::size_t run = ascii_to_utf8_run(utf16.data() + pos, utf16.size() - pos, out + size);
+            pos += run;
+            size += run;
+            if (pos == utf16.size())
+                break;
+        }
+
+        uint32_t c = utf16le_unit(utf16[pos]);
+        if (is_high_surrogate(c) && pos + 1 != utf16.size() && is_low_surrogate(utf16le_unit(utf16[pos + 1]))) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (utf16le_unit(utf16[pos + 1]) - 0xDC00u);
+            ++pos;
+        }
+        else if (is_high_surrogate(c) || is_low_surrogate(c)) {
+            return {pos, size};
+        }
+
+        size += encode_utf8(c, out + size);
+        ++pos;
+    }
+
+    return {std::string_view::npos, size};
+}
+
+
+std::optional<std::string> utf16_to_utf8(std::u16string_view utf16)
+{
+    return convert_to_string<std::string>(utf16, utf16_to_utf8_size(utf16), &utf16_to_utf8);
+}
+
+
+
+std::size_t utf8_to_utf32_size(Utf8_view v) noexcept
+{
+    return code_point_count(v.v_);
+}
+
+
+Transcode_result utf8_to_utf32(Utf8_view v, char32_t* out) noexcept
+{
+    std::size_t end = valid_prefix_size(v.v_);
+    std::size_t size = widen_valid_utf8(v.v_.substr(0, end), out);
+    return {end == v.v_.size() ? std::string_view::npos : end, size};
+}
+
+
+std::optional<std::u32string> utf8_to_utf32(Utf8_view v)
+{
+    return convert_to_string<std::u32string>(v, utf8_to_utf32_size(v), &utf8_to_utf32);
+}
+
+
+std::size_t utf32_to_utf8_size(std::u32string_view utf32) noexcept
+{
+    std::size_t size{0};
+    for (char32_t u : utf32)
+        size += u < 0x80 ? 1 : u < 0x800 ? 2 : u < 0x10000 ? 3 : 4;
+
+    return size;
+}
+
+
+Transcode_result utf32_to_utf8(std::u32string_view utf32, char* out) noexcept
+{
+    auto ascii_to_utf8_run = u8_simd::kernels().utf32_ascii_to_utf8_run;
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != utf32.size()) {
+        std::size_t run = ascii_to_utf8_run(utf32.data() + pos, utf32.size() - pos, out + size);
+        pos += run;
+        size += run;
+        if (pos == utf32.size())
+            break;
+
+        uint32_t c = utf32[pos];
+        if (c > 0x10FFFF || is_high_surrogate(c) || is_low_surrogate(c))
+            return {pos, size};
+
+        size += encode_utf8(c, out + size);
+        ++pos;
+    }
+
+    return {std::string_view::npos, size};
+}
+
+
+std::optional<std::string> utf32_to_utf8(std::u32string_view utf32)
+{
+    return convert_to_string<std::string>(utf32, utf32_to_utf8_size(utf32), &utf32_to_utf8);
+}
@@ -1,62 +1,479 @@
 #include "audaki/u8string.h"
 
+#include "audaki/decoder.h"
+#include "audaki/icase_search.h"
+#include "audaki/simd_kernels.h"
 
+#include <cstdlib>
 
-bool icontains(Utf8_view haystack, Utf8_view needle) noexcept
-{
-    if (needle.byte_count() == 0)
-        return true;
 
-    // If the haystack has less bytes it certainly can't contain the full needle string
-    if (haystack.byte_count() < needle.byte_count())
-        return false;
 
-    assert(haystack.byte_count() > 0 && haystack.byte_count() >= needle.byte_count());
+namespace {
 
-    auto needle_begin = needle.begin();
-    auto needle_it = needle_begin;
-    auto needle_end = needle.end();
-    assert(needle_begin != needle_end);
+using u8_decoder::Checked;
+using u8_decoder::Unchecked;
 
-    auto first_code_point = needle_begin.get();
 
-    auto haystack_begin = haystack.begin();
-    auto haystack_it = haystack_begin;
-    auto haystack_end = haystack.end();
-    assert(haystack_begin != haystack_end);
 
-    auto next_haystack_begin = haystack_begin;
+/**
+ * Is p a code point boundary in both v1 and v2, which are equal before p?
+ *
+ * Bytes which aren't continuation bytes always start a code point. Three continuation bytes before p also make
+ * it a boundary, because no sequence has more than three.
+ */
+bool is_common_boundary(std::string_view v1, std::string_view v2, std::size_t p) noexcept
+{
+    auto is_continuation = [](char c) {
+        return (static_cast<uint8_t>(c) & 0xC0) == 0x80;
+    };
 
-    while (haystack_it != haystack_end) {
+    if (p == 0 || ((p == v1.size() || !is_continuation(v1[p])) && (p == v2.size() || !is_continuation(v2[p]))))
+        return true;
 
-        auto needle_val = needle_it.get();
-        auto haystack_val = haystack_it.get();
+    return p >= 3 && is_continuation(v1[p - 1]) && is_continuation(v1[p - 2]) && is_continuation(v1[p - 3]);
+}
 
-        if (needle_val == first_code_point && needle_it != needle_begin && next_haystack_begin == haystack_begin)
-            next_haystack_begin = haystack_it;
 
-        bool is_matched = needle_val.icompare(haystack_val);
-        if (is_matched) {
+/**
+ * Compare the lower cased code points, the shorter string is less on a common prefix.
+ */
+template<class Decoder>
+int icompare3_impl(std::string_view v1, std::string_view v2) noexcept
+{
+    // Skip the byte identical prefix, then back up to the start of the code point with the first difference
+    const auto& kernels = u8_simd::kernels();
+    std::size_t pos = kernels.common_prefix_length(v1.data(), v2.data(), std::min(v1.size(), v2.size()));
+    while (!is_common_boundary(v1, v2, pos))
+        --pos;
 
-            ++needle_it;
-            if (needle_it == needle_end)
-                return true;
+    std::size_t pos1{pos};
+    std::size_t pos2{pos};
 
-            ++haystack_it;
+    while (true) {
+        // Skip the run of ASCII bytes which are equal ignoring case in bulk
+        std::size_t skip = kernels.ascii_iequal_run_length(v1.data() + pos1, v2.data() + pos2, std::min(v1.size() - pos1, v2.size() - pos2));
+        pos1 += skip;
+        pos2 += skip;
+
+        if (pos1 == v1.size() || pos2 == v2.size())
+            break;
+
+        // Both in U+00C0 to U+00FF, the lower cased second bytes order like the code points
+        if (u8_decoder::is_c3_sequence(v1.data() + pos1, v1.size() - pos1) && u8_decoder::is_c3_sequence(v2.data() + pos2, v2.size() - pos2)) {
+            int lb1 = static_cast<uint8_t>(u8_decoder::lower_c3(v1[pos1 + 1]));
+            int lb2 = static_cast<uint8_t>(u8_decoder::lower_c3(v2[pos2 + 1]));
+            if (lb1 != lb2)
+                return lb1 - lb2;
+
+            pos1 += 2;
+            pos2 += 2;
             continue;
         }
 
+        auto c1 = Decoder::decode(v1.data() + pos1, v1.size() - pos1);
+        auto c2 = Decoder::decode(v2.data() + pos2, v2.size() - pos2);
+
+        auto lc1 = c1.code_point.as_lower_case();
+        auto lc2 = c2.code_point.as_lower_case();
+        if (lc1 != lc2)
+            return lc1.v_ < lc2.v_ ? -1 : 1;
+
+        pos1 += c1.byte_count;
+        pos2 += c2.byte_count;
+    }
 
-        assert(!is_matched);
-        needle_it = needle_begin;
-        if (next_haystack_begin != haystack_begin) {
-            haystack_it = next_haystack_begin;
-            next_haystack_begin = haystack_begin;
+    bool is_end1 = pos1 == v1.size();
+    bool is_end2 = pos2 == v2.size();
+    return is_end1 == is_end2 ? 0 : (is_end1 ? -1 : 1);
+}
+
+
+
+/**
+ * Case mapping of a single non-ASCII code point at p, writes the mapped bytes to out if out isn't null.
+ */
+struct Case_mapped {
+    std::size_t consumed;
+    std::size_t produced;
+};
+
+template<class Decoder, bool upper>
+Case_mapped case_map_code_point(const char* p, std::size_t n, char* out) noexcept
+{
+    // U+00C0 to U+00FF map within C3 80 to C3 BF, except for ß which becomes E1 BA 9E
+    bool is_eszett = upper && n >= 2 && p[0] == '\xC3' && p[1] == '\x9F';
+    if (u8_decoder::is_c3_sequence(p, n) && !is_eszett) {
+        if (out) {
+            auto& table = upper ? u8_case::upper_c3 : u8_case::lower_c3;
+            out[0] = p[0];
+            out[1] = static_cast<char>(table[static_cast<uint8_t>(p[1]) & 0x3F]);
         }
-        else {
-            ++haystack_it;
+
+        return {2, 2};
+    }
+
+    auto decoded = Decoder::decode(p, n);
+    auto mapped = upper ? decoded.code_point.as_upper_case() : decoded.code_point.as_lower_case();
+    std::size_t size = u8_search::utf8_byte_count(mapped);
+    if (out)
+        std::memcpy(out, mapped.to_utf8().data(), size);
+
+    return {decoded.byte_count, size};
+}
+
+
+/**
+ * Exact size of the case mapped view. Only ß/ẞ and ill-formed sequences (U+FFFD) change the encoded length.
+ */
+template<class Decoder, bool upper>
+std::size_t case_mapped_size(std::string_view v) noexcept
+{
+    auto ascii_run_length = u8_simd::kernels().ascii_run_length;
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != v.size()) {
+        std::size_t run = ascii_run_length(v.data() + pos, v.size() - pos);
+        size += run;
+        pos += run;
+        if (pos == v.size())
+            break;
+
+        auto mapped = case_map_code_point<Decoder, upper>(v.data() + pos, v.size() - pos, nullptr);
+        size += mapped.produced;
+        pos += mapped.consumed;
+    }
+
+    return size;
+}
+
+
+/**
+ * Write the case mapped view to out, which has room for case_mapped_size bytes. Returns the number of bytes written.
+ */
+template<class Decoder, bool upper>
+std::size_t case_map_into(std::string_view v, char* out) noexcept
+{
+    auto case_map_run = upper ? u8_simd::kernels().ascii_to_upper_run : u8_simd::kernels().ascii_to_lower_run;
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != v.size()) {
+        std::size_t run = case_map_run(v.data() + pos, v.size() - pos, out + size);
+        size += run;
+        pos += run;
+        if (pos == v.size())
+            break;
+
+        auto mapped = case_map_code_point<Decoder, upper>(v.data() + pos, v.size() - pos, out + size);
+        size += mapped.produced;
+        pos += mapped.consumed;
+    }
+
+    return size;
+}
+
+
+template<class Decoder, bool upper>
+void case_map_append(std::string_view v, std::string& out)
+{
+    std::size_t offset = out.size();
+    out.resize(offset + case_mapped_size<Decoder, upper>(v));
+    case_map_into<Decoder, upper>(v, out.data() + offset);
+}
+
+
+template<class Decoder, bool upper>
+std::string case_mapped_string(std::string_view v)
+{
+    std::string string;
+    case_map_append<Decoder, upper>(v, string);
+    return string;
+}
+
+
+/**
+ * Case map s in place as long as the mapped bytes don't overtake the input, which only ß to ẞ and U+FFFD can do.
+ * From there the rest is mapped to a separate buffer.
+ */
+template<class Decoder, bool upper>
+void case_map_in_place(std::string& s)
+{
+    auto case_map_run = upper ? u8_simd::kernels().ascii_to_upper_run : u8_simd::kernels().ascii_to_lower_run;
+    char* data = s.data();
+    std::size_t size{0};
+    std::size_t pos{0};
+
+    while (pos != s.size()) {
+        // The run stores every block after loading it, so writing behind the read position is safe
+        std::size_t run = case_map_run(data + pos, s.size() - pos, data + size);
+        size += run;
+        pos += run;
+        if (pos == s.size())
+            break;
+
+        std::array<char, 4> mapped_bytes;
+        auto mapped = case_map_code_point<Decoder, upper>(data + pos, s.size() - pos, mapped_bytes.data());
+        if (size + mapped.produced > pos + mapped.consumed) {
+            std::string rest;
+            case_map_append<Decoder, upper>(std::string_view{s}.substr(pos), rest);
+            s.resize(size);
+            s += rest;
+            return;
         }
+
+        std::memcpy(data + size, mapped_bytes.data(), mapped.produced);
+        size += mapped.produced;
+        pos += mapped.consumed;
+    }
+
+    s.resize(size);
+}
+
+}
+
+
+
+bool Utf8_view::icompare(Utf8_view other) noexcept
+{
+    return icompare3_impl<Checked>(v_, other.v_) == 0;
+}
+
+
+bool Utf8_view::iless(Utf8_view other) noexcept
+{
+    return icompare3_impl<Checked>(v_, other.v_) < 0;
+}
+
+
+bool u8_iequal(Validated_utf8_view v1, Validated_utf8_view v2) noexcept
+{
+    return icompare3_impl<Unchecked>(v1.string_view(), v2.string_view()) == 0;
+}
+
+
+bool u8_iless(Validated_utf8_view v1, Validated_utf8_view v2) noexcept
+{
+    return icompare3_impl<Unchecked>(v1.string_view(), v2.string_view()) < 0;
+}
+
+
+int u8_icompare3(Utf8_view v1, Utf8_view v2) noexcept
+{
+    return icompare3_impl<Checked>(v1.v_, v2.v_);
+}
+
+
+int u8_icompare3(Validated_utf8_view v1, Validated_utf8_view v2) noexcept
+{
+    return icompare3_impl<Unchecked>(v1.string_view(), v2.string_view());
+}
+
+
+
+std::string as_lower_cased_string(Utf8_view v)
+{
+    return case_mapped_string<Checked, false>(v.v_);
+}
+
+
+std::string as_upper_cased_string(Utf8_view v)
+{
+    return case_mapped_string<Checked, true>(v.v_);
+}
+
+
+std::string as_lower_cased_string(Validated_utf8_view v)
+{
+    return case_mapped_string<Unchecked, false>(v.string_view());
+}
+
+
+std::string as_upper_cased_string(Validated_utf8_view v)
+{
+    return case_mapped_string<Unchecked, true>(v.string_view());
+}
+
+
+std::size_t lower_cased_size(Utf8_view v) noexcept
+{
+    return case_mapped_size<Checked, false>(v.v_);
+}
+
+
+std::size_t upper_cased_size(Utf8_view v) noexcept
+{
+    return case_mapped_size<Checked, true>(v.v_);
+}
+
+
+std::size_t to_lower_into(Utf8_view v, char* out) noexcept
+{
+    return case_map_into<Checked, false>(v.v_, out);
+}
+
+
+std::size_t to_upper_into(Utf8_view v, char* out) noexcept
+{
+    return case_map_into<Checked, true>(v.v_, out);
+}
+
+
+void to_lower_into(Utf8_view v, std::string& out)
+{
+    case_map_append<Checked, false>(v.v_, out);
+}
+
+
+void to_upper_into(Utf8_view v, std::string& out)
+{
+    case_map_append<Checked, true>(v.v_, out);
+}
+
+
+void to_lower_into(Validated_utf8_view v, std::string& out)
+{
+    case_map_append<Unchecked, false>(v.string_view(), out);
+}
+
+
+void to_upper_into(Validated_utf8_view v, std::string& out)
+{
+    case_map_append<Unchecked, true>(v.string_view(), out);
+}
+
+
+void to_lower_in_place(std::string& s)
+{
+    case_map_in_place<Checked, false>(s);
+}
+
+
+void to_upper_in_place(std::string& s)
+{
+    case_map_in_place<Checked, true>(s);
+}
+
+
+
+bool icontains(Utf8_view haystack, Utf8_view needle)
+{
+    u8_search::Folded_needle<Checked> folded_needle{needle.v_};
+    return u8_search::contains_folded<Checked>(haystack.v_, folded_needle.view());
+}
+
+
+bool icontains(Validated_utf8_view haystack, Validated_utf8_view needle)
+{
+    u8_search::Folded_needle<Unchecked> folded_needle{needle.string_view()};
+    return u8_search::contains_folded<Unchecked>(haystack.string_view(), folded_needle.view());
+}
+
+
+
+std::size_t find_truncation_point(std::string_view v, std::size_t max_length, std::size_t max_lines) noexcept
+{
+    std::size_t point = u8_simd::kernels().truncation_point(v.data(), v.size(), max_length, max_lines);
+    return point == v.size() ? std::string_view::npos : point;
+}
+
+
+
+namespace {
+
+const u8_simd::Kernels& kernels_of(Simd_level level) noexcept
+{
+#ifdef AUDAKI_U8STRING_DISPATCH_X86
+    switch (level) {
+    case Simd_level::scalar:
+        return u8_simd::swar_kernels;
+    case Simd_level::sse2:
+        return u8_simd::sse2_kernels;
+    case Simd_level::sse42:
+        return u8_simd::sse42_kernels;
+    case Simd_level::avx2:
+        return u8_simd::avx2_kernels;
+    }
+#endif
+
+    (void)level;
+    return u8_simd::swar_kernels;
+}
+
+
+std::optional<Simd_level> parse_simd_level(std::string_view name) noexcept
+{
+    if (name == "scalar")
+        return Simd_level::scalar;
+    if (name == "sse2")
+        return Simd_level::sse2;
+    if (name == "sse4.2")
+        return Simd_level::sse42;
+    if (name == "avx2")
+        return Simd_level::avx2;
+
+    return std::nullopt;
+}
+
+
+std::atomic<Simd_level> active_simd_level{Simd_level::scalar};
+
+}
+
+
+std::atomic<const u8_simd::Kernels*> u8_simd::active_kernels{nullptr};
+
+
+const u8_simd::Kernels& u8_simd::select_kernels() noexcept
+{
+    Simd_level level = max_simd_level();
+    if (const char* name = std::getenv("AUDAKI_U8STRING_SIMD_LEVEL")) {
+        if (auto forced = parse_simd_level(name))
+            level = std::min(level, *forced);
     }
 
-    return false;
+    set_simd_level(level);
+    return *active_kernels.load(std::memory_order_acquire);
+}
+
+
+
+Simd_level simd_level() noexcept
+{
+    u8_simd::kernels();
+    return active_simd_level.load(std::memory_order_relaxed);
+}
+
+
+Simd_level max_simd_level() noexcept
+{
+#ifdef AUDAKI_U8STRING_DISPATCH_X86
+    // cpuid once, the AVX2 check includes the OS saving the AVX registers
+    static const Simd_level level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+            return Simd_level::avx2;
+        if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+            return Simd_level::sse42;
+        if (__builtin_cpu_supports("sse2"))
+            return Simd_level::sse2;
+
+        return Simd_level::scalar;
+    }();
+
+    return level;
+#else
+    return Simd_level::scalar;
+#endif
+}
+
+
+bool set_simd_level(Simd_level level) noexcept
+{
+    if (level > max_simd_level())
+        return false;
+
+    active_simd_level.store(level, std::memory_order_relaxed);
+    u8_simd::active_kernels.store(&kernels_of(level), std::memory_order_release);
+    return true;
 }
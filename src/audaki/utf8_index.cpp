@@ -0,0 +1,123 @@
+#include "audaki/u8string.h"
+
+#include "audaki/simd_kernels.h"
+
+
+
+namespace {
+
+bool is_continuation(char c) noexcept
+{
+    return (static_cast<uint8_t>(c) & 0xC0) == 0x80;
+}
+
+
+/**
+ * Append the offset of every interval-th code point of valid UTF-8 to checkpoints, returns the code point count.
+ */
+std::size_t index_valid(std::string_view v, std::size_t interval, std::vector<std::size_t>& checkpoints)
+{
+    std::size_t first = checkpoints.size();
+    checkpoints.resize(first + (v.size() + interval - 1) / interval);
+
+    std::size_t count = u8_simd::kernels().utf8_count_code_points(v.data(), v.size(), interval, checkpoints.data() + first);
+    checkpoints.resize(first + (count + interval - 1) / interval);
+    return count;
+}
+
+
+/**
+ * Like index_valid, for input with ill-formed sequences, which is decoded code point by code point.
+ */
+std::size_t index_decoded(std::string_view v, std::size_t interval, std::vector<std::size_t>& checkpoints)
+{
+    std::size_t count{0};
+    for (std::size_t i{0}; i != v.size(); i += decode_utf8(v.data() + i, v.size() - i).byte_count) {
+        if (count % interval == 0)
+            checkpoints.push_back(i);
+        ++count;
+    }
+
+    return count;
+}
+
+}
+
+
+
+Utf8_index::Utf8_index(Utf8_view v): view_{v}, is_valid_{static_cast<bool>(validate_utf8(v.v_))}
+{
+    checkpoints_.reserve(v.v_.size() / checkpoint_interval + 1);
+    length_ = is_valid_ ? index_valid(v.v_, checkpoint_interval, checkpoints_) : index_decoded(v.v_, checkpoint_interval, checkpoints_);
+}
+
+
+Utf8_index::Utf8_index(Validated_utf8_view v): view_{v}, is_valid_{true}
+{
+    checkpoints_.reserve(v.byte_count() / checkpoint_interval + 1);
+    length_ = index_valid(v.string_view(), checkpoint_interval, checkpoints_);
+}
+
+
+std::size_t Utf8_index::advance(std::size_t offset, std::size_t n) const noexcept
+{
+    std::string_view v = view_.v_;
+    for (; n && offset != v.size(); --n) {
+        if (is_valid_) {
+            ++offset;
+            while (offset != v.size() && is_continuation(v[offset]))
+                ++offset;
+        }
+        else {
+            offset += decode_utf8(v.data() + offset, v.size() - offset).byte_count;
+        }
+    }
+
+    return offset;
+}
+
+
+std::size_t Utf8_index::byte_offset(std::size_t n) const noexcept
+{
+    if (n >= length_)
+        return view_.v_.size();
+
+    return advance(checkpoints_[n / checkpoint_interval], n % checkpoint_interval);
+}
+
+
+std::size_t Utf8_index::code_point_index(std::size_t offset) const noexcept
+{
+    if (offset >= view_.v_.size())
+        return length_;
+
+    // The first checkpoint is offset 0, so there always is one at or before offset
+    auto checkpoint = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), offset) - 1;
+    std::size_t index = static_cast<std::size_t>(checkpoint - checkpoints_.begin()) * checkpoint_interval;
+    for (std::size_t pos = *checkpoint; (pos = advance(pos, 1)) <= offset;)
+        ++index;
+
+    return index;
+}
+
+
+Unicode_code_point Utf8_index::at(std::size_t n) const noexcept
+{
+    std::size_t offset = byte_offset(n);
+    if (is_valid_)
+        return decode_valid_utf8(view_.v_.data() + offset).code_point;
+
+    return decode_utf8(view_.v_.data() + offset, view_.v_.size() - offset).code_point;
+}
+
+
+std::string_view Utf8_index::substr_cp(std::size_t begin, std::size_t count) const noexcept
+{
+    std::size_t begin_offset = byte_offset(begin);
+    if (begin >= length_ || count >= length_ - begin)
+        return view_.v_.substr(begin_offset);
+
+    // Short ranges decode on from begin instead of from the last checkpoint before the end
+    std::size_t end_offset = count < checkpoint_interval ? advance(begin_offset, count) : byte_offset(begin + count);
+    return view_.v_.substr(begin_offset, end_offset - begin_offset);
+}
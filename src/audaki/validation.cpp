@@ -0,0 +1,64 @@
+#include "audaki/u8string.h"
+
+#include "audaki/simd_kernels.h"
+
+
+
+/**
+ * Scalar validation starting at a code point, returns the offset of the first error or npos.
+ */
+static std::size_t find_utf8_error(const char* data, std::size_t size, std::size_t pos) noexcept
+{
+    auto ascii_run_length = u8_simd::kernels().ascii_run_length;
+    while (pos != size) {
+        pos += ascii_run_length(data + pos, size - pos);
+        if (pos == size)
+            break;
+
+        auto decoded = decode_utf8(data + pos, size - pos);
+        bool is_replacement = decoded.code_point.v_ == 0xFFFDu;
+        if (is_replacement && (decoded.byte_count != 3 || std::string_view{data + pos, 3} != "\xEF\xBF\xBD"))
+            return pos;
+
+        pos += decoded.byte_count;
+    }
+
+    return std::string_view::npos;
+}
+
+
+/**
+ * Where to continue with the scalar validator once the vector checks flagged the block at pos.
+ *
+ * Errors flagged at pos can involve the last three bytes before it (a lead byte still waiting for its
+ * continuation bytes), everything before those passed. So start at the code point containing pos - 4.
+ */
+static std::size_t scalar_restart(const char* data, std::size_t pos) noexcept
+{
+    if (pos < 4)
+        return 0;
+
+    pos -= 4;
+    for (std::size_t i{0}; i != 3 && pos != 0 && get_utf8_byte_type(std::byte{static_cast<uint8_t>(data[pos])}) == Utf8_byte_type::continuation_byte; ++i)
+        --pos;
+
+    return pos;
+}
+
+
+
+Utf8_validation validate_utf8(std::string_view v) noexcept
+{
+    // The exact offset is found by the scalar validator, starting at the code point which spans into the flagged block
+    std::size_t pos = u8_simd::kernels().utf8_checked_length(v.data(), v.size());
+    return {find_utf8_error(v.data(), v.size(), scalar_restart(v.data(), pos))};
+}
+
+
+std::optional<Validated_utf8_view> make_validated_utf8_view(std::string_view v) noexcept
+{
+    if (!validate_utf8(v))
+        return std::nullopt;
+
+    return Validated_utf8_view{v, Validated_utf8_view::Validated{}};
+}
@@ -3,6 +3,12 @@
 
 #include "audaki/u8string.h"
 
+#include <atomic>
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <unordered_set>
+
 
 
 TEST_CASE("Test u8_iequal", "[string, utf8, u8_iequal]")
@@ -23,3 +29,1050 @@ TEST_CASE("Test u8_iless", "[string, utf8, u8_iless]")
     CHECK(u8_iless("asdäöü", "ASDÄÖÜẞ"));
     CHECK_FALSE(u8_iless("asdäöüß", "ASDÄÖÜ"));
 }
+
+
+TEST_CASE("Test ASCII fast paths", "[string, utf8, ascii]")
+{
+    std::string ascii_lower = "the quick brown fox jumps over the lazy dog, 0123456789!";
+    std::string ascii_upper = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG, 0123456789!";
+
+    CHECK(u8_iequal(ascii_lower + "äöü" + ascii_lower, ascii_upper + "ÄÖÜ" + ascii_upper));
+    CHECK_FALSE(u8_iequal(ascii_lower + "äöü" + ascii_lower, ascii_upper + "ÄÖÜ" + ascii_upper + "!"));
+    CHECK(u8_iless(ascii_upper + "a", ascii_lower + "b"));
+    CHECK_FALSE(u8_iless(ascii_upper + "ä", ascii_lower + "b"));
+
+    CHECK(as_lower_cased_string(ascii_upper + "ÄÖÜẞ" + ascii_upper) == ascii_lower + "äöüß" + ascii_lower);
+    CHECK(as_upper_cased_string(ascii_lower + "äöüß" + ascii_lower) == ascii_upper + "ÄÖÜẞ" + ascii_upper);
+
+    CHECK(icontains(ascii_lower + "Müller" + ascii_lower, "MÜLLER"));
+    CHECK(icontains(ascii_lower, "LAZY DOG"));
+    CHECK(icontains("aab", "ab"));
+    CHECK(icontains("ääöx", "äöX"));
+    CHECK_FALSE(icontains(ascii_lower, "lazy cat"));
+}
+
+
+TEST_CASE("Test validate_utf8", "[string, utf8, validation]")
+{
+    std::string ascii(70, 'x');
+
+    CHECK(validate_utf8(""));
+    CHECK(validate_utf8("asdäöüß ẞ € 😀"));
+    CHECK(validate_utf8(ascii + "äöü" + ascii + "😀"));
+    CHECK(validate_utf8("\xEF\xBF\xBD"));
+
+    CHECK(validate_utf8("ab\x80").error_offset == 2);
+    CHECK(validate_utf8("ab\xC3").error_offset == 2);
+    CHECK(validate_utf8("\xC0\xAF").error_offset == 0);
+    CHECK(validate_utf8("\xE0\x80\xAF").error_offset == 0);
+    CHECK(validate_utf8("\xED\xA0\x80").error_offset == 0);
+    CHECK(validate_utf8("\xF4\x90\x80\x80").error_offset == 0);
+    CHECK(validate_utf8("\xF8\x88\x80\x80\x80").error_offset == 0);
+    CHECK(validate_utf8(ascii + "\xC3" + ascii).error_offset == 70);
+    CHECK(validate_utf8(ascii + "ä" + ascii + "\xE2\x82").error_offset == 142);
+    CHECK(validate_utf8(std::string(31, 'x') + "ä" + ascii + "\xFF").error_offset == 103);
+
+    CHECK(get_utf8_byte_type(std::byte{0xF8}) == Utf8_byte_type::invalid_byte);
+
+    CHECK_FALSE(make_validated_utf8_view("a\xC3"));
+    std::string text = ascii + "MÜLLER";
+    auto haystack = make_validated_utf8_view(text);
+    auto needle = make_validated_utf8_view("müller");
+    REQUIRE(haystack);
+    REQUIRE(needle);
+    CHECK(icontains(*haystack, *needle));
+    CHECK(u8_iequal(*needle, *make_validated_utf8_view("MÜLLER")));
+    CHECK(as_upper_cased_string(*needle) == "MÜLLER");
+}
+
+
+TEST_CASE("Test decoding of ill-formed input", "[string, utf8, decode]")
+{
+    CHECK(u8_iequal("a\xC3", "A\xEF\xBF\xBD"));
+    CHECK(u8_iequal("\xE2\x82", "\xEF\xBF\xBD"));
+    CHECK(u8_iequal("\xC0\x80", "\xEF\xBF\xBD\xEF\xBF\xBD"));
+    CHECK(as_lower_cased_string("\xC3" "A") == "\xEF\xBF\xBD" "a");
+    CHECK(icontains("x\xC3" "ab", "AB"));
+}
+
+
+TEST_CASE("Test icontains search engine", "[string, utf8, icontains]")
+{
+    std::string filler;
+    for (int i = 0; i != 500; ++i)
+        filler += "Produktbeschreibung für Kunden ";
+
+    std::string long_needle = "Größere Nadel, die deutlich länger als zweiunddreißig Bytes ist";
+    std::string long_needle_upper = as_upper_cased_string(long_needle);
+
+    CHECK(icontains(filler + long_needle_upper + filler, long_needle));
+    CHECK(icontains(filler + long_needle, long_needle_upper));
+    CHECK_FALSE(icontains(filler + long_needle.substr(0, 40) + filler, long_needle));
+    CHECK(icontains(filler + "ẞ", "ß"));
+    CHECK(icontains("ß", "ẞ"));
+    CHECK(icontains(filler + "x", "X"));
+    CHECK_FALSE(icontains(filler, "q"));
+
+    // Matches crossing the folding chunk boundaries
+    for (std::size_t offset = 4000; offset < 4200; offset += 7) {
+        std::string haystack = std::string(offset, 'x') + "MÜLLERSTRAẞE" + std::string(100, 'x');
+        CHECK(icontains(haystack, "müllerstraße"));
+    }
+
+    std::string periodic(3000, 'a');
+    CHECK(icontains(periodic + "b", std::string(40, 'a') + "b"));
+    CHECK_FALSE(icontains(periodic, std::string(40, 'a') + "b"));
+
+    // Needles which don't fold on the stack
+    CHECK(icontains(filler + std::string(300, 'X') + "ÄÖÜ" + filler, std::string(300, 'x') + "äöü"));
+    CHECK_FALSE(icontains(filler + std::string(300, 'X') + "ÄÖ" + filler, std::string(300, 'x') + "äöü"));
+}
+
+
+TEST_CASE("Test Icase_pattern", "[string, utf8, icase_pattern]")
+{
+    Icase_pattern pattern{"straße"};
+    Icase_pattern copy = pattern;
+
+    CHECK(copy.folded_needle() == "straße");
+    CHECK(pattern.contains("Hauptstrasse, Bahnhofstraße"));
+    CHECK_FALSE(pattern.contains("Hauptstrasse"));
+
+    auto match = pattern.find("Hauptstrasse, BAHNHOFSTRAẞE 1");
+    REQUIRE(match);
+    CHECK(match->begin == 21);
+    CHECK(match->end == 29);
+
+    std::string text;
+    for (int i = 0; i != 1000; ++i)
+        text += i % 2 ? "Lindenstraße " : "LINDENSTRAẞE ";
+
+    auto matches = copy.find_all(text);
+    REQUIRE(matches.size() == 1000);
+    CHECK(matches[1].begin == 21);
+    CHECK(matches[1].end == 28);
+    CHECK(text.substr(matches[998].begin, matches[998].end - matches[998].begin) == "STRAẞE");
+
+    CHECK(Icase_pattern{"aa"}.find_all("AAAAA").size() == 2);
+    CHECK(Icase_pattern{""}.find("abc")->begin == 0);
+    CHECK(Icase_pattern{"x"}.find_all("xXx").size() == 3);
+}
+
+
+TEST_CASE("Test Icase_pattern_set", "[string, utf8, icase_pattern_set]")
+{
+    Icase_pattern_set set{"he", "SHE", "his", "hers", "Straße"};
+    CHECK(set.pattern_count() == 5);
+
+    auto matches = set.find_all("USHERS");
+    REQUIRE(matches.size() == 3);
+    CHECK(matches[0].pattern == 1);
+    CHECK(matches[0].begin == 1);
+    CHECK(matches[0].end == 4);
+    CHECK(matches[1].pattern == 0);
+    CHECK(matches[1].begin == 2);
+    CHECK(matches[2].pattern == 3);
+    CHECK(matches[2].end == 6);
+
+    CHECK(set.contains_any("BAHNHOFSTRAẞE"));
+    CHECK_FALSE(set.contains_any("Bahnhofstrasse"));
+    CHECK(set.matched_patterns("this, hers and the STRAẞE") == std::vector<std::size_t>{0, 2, 3, 4});
+
+    auto straße = set.find_all("Die STRAẞE");
+    REQUIRE(straße.size() == 1);
+    CHECK(straße[0].begin == 4);
+    CHECK(straße[0].end == 12);
+
+    std::vector<std::string> keywords;
+    for (int i = 0; i != 500; ++i)
+        keywords.push_back("keyword" + std::to_string(i) + "é");
+
+    Icase_pattern_set copy = Icase_pattern_set{keywords};
+    std::string text(10000, ' ');
+    text += "KEYWORD42É KEYWORD499É";
+    CHECK(copy.matched_patterns(text) == std::vector<std::size_t>{42, 499});
+    CHECK(copy.matched_patterns(*make_validated_utf8_view(text)) == std::vector<std::size_t>{42, 499});
+}
+
+
+TEST_CASE("Test case mapping tables", "[string, utf8, case_mapping]")
+{
+    for (uint32_t c = 0; c != 0x2000; ++c) {
+        Unicode_code_point cp{c};
+        bool is_upper = (c >= 'A' && c <= 'Z') || (c >= 0xC0 && c <= 0xDE);
+        bool is_lower = (c >= 'a' && c <= 'z') || (c >= 0xE0 && c <= 0xFE && c != 0xDF);
+
+        CHECK(cp.as_lower_case().v_ == (is_upper ? c + 0x20 : c == 0x1E9E ? 0xDF : c));
+        CHECK(cp.as_upper_case().v_ == (is_lower ? c - 0x20 : c == 0xDF ? 0x1E9E : c));
+        CHECK(cp.icompare(cp.as_upper_case()));
+        CHECK(cp.icompare(cp.as_lower_case()));
+    }
+
+    CHECK_FALSE(Unicode_code_point{U'ÿ'}.icompare(Unicode_code_point{U'Ÿ'}));
+    CHECK_FALSE(Unicode_code_point{U'a'}.icompare(Unicode_code_point{U'á'}));
+
+    CHECK(u8_iequal("ÀÉÎÕÜ×", "àéîõü÷"));
+    CHECK_FALSE(u8_iequal("Àb", "áb"));
+    CHECK(u8_iless("À", "á"));
+    CHECK(u8_iless("ä", "Ö"));
+    CHECK_FALSE(u8_iless("Ä", "b"));
+
+    CHECK(as_upper_cased_string("àßẞÿæ") == "ÀẞẞÿÆ");
+    CHECK(as_lower_cased_string("ÀßẞŸÆ") == "àßßŸæ");
+    CHECK(icontains("Fußgänger", "GÄNG"));
+}
+
+
+TEST_CASE("Test case conversion into caller buffers", "[string, utf8, case_mapping]")
+{
+    std::string text;
+    for (int i = 0; i != 100; ++i)
+        text += i % 7 ? "Grüße aus der STRAẞE, " : "bad \xC3 byte\x80 ";
+
+    std::string lower = as_lower_cased_string(text);
+    std::string upper = as_upper_cased_string(text);
+    CHECK(lower_cased_size(text) == lower.size());
+    CHECK(upper_cased_size(text) == upper.size());
+
+    std::vector<char> buffer(lower.size());
+    CHECK(to_lower_into(text, buffer.data()) == lower.size());
+    CHECK(std::string_view(buffer.data(), buffer.size()) == lower);
+
+    std::string appended = "prefix ";
+    to_upper_into(text, appended);
+    CHECK(appended == "prefix " + upper);
+
+    std::string copied;
+    to_lower_copy(text, std::back_inserter(copied));
+    CHECK(copied == lower);
+
+    std::vector<char> upper_copied;
+    to_upper_copy(text, std::back_inserter(upper_copied));
+    CHECK(std::string_view(upper_copied.data(), upper_copied.size()) == upper);
+
+    std::string in_place = text;
+    to_lower_in_place(in_place);
+    CHECK(in_place == lower);
+
+    in_place = text;
+    to_upper_in_place(in_place);
+    CHECK(in_place == upper);
+
+    std::string shrinking = "STRAẞE ẞẞ ÄÖÜ";
+    to_lower_in_place(shrinking);
+    CHECK(shrinking == "straße ßß äöü");
+
+    std::string growing = "straße ß";
+    to_upper_in_place(growing);
+    CHECK(growing == "STRAẞE ẞ");
+}
+
+
+TEST_CASE("Test case insensitive hashing", "[string, utf8, hash]")
+{
+    // xxHash64 of the folded bytes "abc"
+    CHECK(u8_ihash("ABC") == 0x44BC'2CF5'AD77'0999u);
+    CHECK(u8_ihash("Straße") == u8_ihash("STRAẞE"));
+    CHECK(u8_ihash("ÄÖÜ abc") == u8_ihash("äöü ABC"));
+    CHECK(u8_ihash("bad \xC3") == u8_ihash("BAD \xEF\xBF\xBD"));
+    CHECK(u8_ihash("abc") != u8_ihash("abd"));
+    CHECK(u8_ihash("") != u8_ihash(std::string_view("\0", 1)));
+
+    // Long input is hashed across several folding chunks and hash stripes
+    std::string text;
+    for (int i = 0; i != 200; ++i)
+        text += "Grüße aus der STRAẞE ";
+
+    std::string lower = as_lower_cased_string(text);
+    CHECK(u8_ihash(text) == u8_ihash(lower));
+    CHECK(u8_ihash(*make_validated_utf8_view(text)) == u8_ihash(lower));
+    CHECK(u8_ihash(text) != u8_ihash(std::string_view(lower).substr(1)));
+
+    std::unordered_set<std::string, Icase_hash, Icase_equal> emails{"Jane.Doe@Example.com", "max@müller.de"};
+    CHECK(emails.count("jane.doe@example.COM") == 1);
+    CHECK(emails.count("MAX@MÜLLER.DE") == 1);
+    CHECK(emails.count("max@muller.de") == 0);
+
+    std::set<std::string, Icase_less> tags{"Straße", "Äpfel", "zebra"};
+    CHECK(tags.find(std::string_view{"STRAẞE"}) != tags.end());
+    CHECK(tags.find(Utf8_view{"äPFEL"}) != tags.end());
+    CHECK(tags.size() == 3);
+}
+
+
+TEST_CASE("Test case insensitive sorting", "[string, utf8, isort]")
+{
+    CHECK(make_isort_key("STRAẞE") == make_isort_key("straße"));
+    CHECK(make_isort_key("ÄB") < make_isort_key("äc"));
+    CHECK(make_isort_key("ab") < make_isort_key("ABC"));
+
+    std::vector<std::string> names{"Zoe", "äpfel", "adam", "Ädam", "ADAM", "Straße", "strasse", "STRAẞE", "", "b"};
+    u8_isort(names);
+    CHECK(names == std::vector<std::string>{"", "adam", "ADAM", "b", "strasse", "Straße", "STRAẞE", "Zoe", "Ädam", "äpfel"});
+
+    // Enough strings for radix sort and the parallel mode, with long common prefixes
+    std::vector<std::string> many;
+    for (int i = 0; i != 40000; ++i)
+        many.push_back((i % 3 ? "Customer Nr. " : "CUSTOMER NR. ") + std::to_string((i * 7919) % 40000) + (i % 2 ? "ä" : "Ä"));
+
+    auto sequential = many;
+    u8_isort(sequential);
+    CHECK(std::is_sorted(sequential.begin(), sequential.end(), [](const std::string& s1, const std::string& s2) { return u8_iless(s1, s2); }));
+
+    auto parallel = many;
+    u8_isort(parallel, Execution::parallel);
+    CHECK(parallel == sequential);
+
+    auto stable = many;
+    std::stable_sort(stable.begin(), stable.end(), [](const std::string& s1, const std::string& s2) { return u8_iless(s1, s2); });
+    CHECK(stable == sequential);
+}
+
+
+TEST_CASE("Test u8_icompare3", "[string, utf8, u8_icompare3]")
+{
+    CHECK(u8_icompare3("Straße", "STRAẞE") == 0);
+    CHECK(u8_icompare3("abc", "ABD") < 0);
+    CHECK(u8_icompare3("abd", "ABC") > 0);
+    CHECK(u8_icompare3("ab", "ABC") < 0);
+    CHECK(u8_icompare3("", "") == 0);
+
+    // The first difference is inside a code point of a long byte identical prefix
+    std::string prefix(100, 'x');
+    CHECK(u8_icompare3(prefix + "ä", prefix + "Ä") == 0);
+    CHECK(u8_icompare3(prefix + "ä", prefix + "ö") < 0);
+    CHECK(u8_icompare3(prefix + "\xC3", prefix + "\xC3\xA4") > 0);
+    CHECK(u8_icompare3(prefix + "ẞ", prefix + "ß") == 0);
+
+    std::vector<std::string> strings{"", "a", "A", "ab", "äb", "ÄB", "b", "ß", "ẞ", "ss", "\xC3", "\xEF\xBF\xBD"};
+    for (const auto& s1 : strings) {
+        for (const auto& s2 : strings) {
+            CHECK((u8_icompare3(s1, s2) < 0) == u8_iless(s1, s2));
+            CHECK((u8_icompare3(s1, s2) == 0) == u8_iequal(s1, s2));
+        }
+    }
+}
+
+
+TEST_CASE("Test split_view", "[string, split]")
+{
+    std::vector<std::string_view> pieces;
+    split_into<','>("a,,bä,", pieces);
+    CHECK(pieces == std::vector<std::string_view>{"a", "", "bä", ""});
+
+    split_into<','>("", pieces);
+    CHECK(pieces == std::vector<std::string_view>{""});
+
+    split_into("key=välue; other\tx", std::array<char, 3>{'=', ';', '\t'}, pieces);
+    CHECK(pieces == std::vector<std::string_view>{"key", "välue", " other", "x"});
+
+    // Long lines are scanned in vector sized blocks
+    std::string line;
+    for (int i = 0; i != 1000; ++i)
+        line += "field" + std::to_string(i) + (i % 2 ? "|" : ";");
+
+    std::size_t count{0};
+    std::size_t mismatches{0};
+    for (auto piece : split_view(line, std::array<char, 2>{'|', ';'})) {
+        if (count != 1000 && piece != "field" + std::to_string(count))
+            ++mismatches;
+        ++count;
+    }
+    CHECK(count == 1001);
+    CHECK(mismatches == 0);
+
+    auto view = split_view<'|'>(line);
+    CHECK(std::distance(view.begin(), view.end()) == 501);
+
+    CHECK(split<','>("a,,b") == std::vector<std::string>{"a", "", "b"});
+    CHECK(split("a b\tc", std::array<char, 2>{' ', '\t'}) == std::vector<std::string>{"a", "b", "c"});
+}
+
+
+TEST_CASE("Test Byte_class", "[string, split, byte_class]")
+{
+    // Small classes, more than 8 distinct low nibble sets and non-ASCII bytes take different paths
+    std::string ascii;
+    for (int c = 1; c != 128; ++c)
+        ascii += static_cast<char>(c);
+    std::vector<std::string> sets{",", ",; \t", std::string(" \t\n\r\v\f"), "0123456789abcdefABCDEF", ascii, "\xC3\x80\xFF", ""};
+
+    std::string text;
+    for (int i = 0; i != 200; ++i)
+        text += "wörd" + std::to_string(i) + (i % 3 ? ", " : ";\t") + (i % 7 ? "" : "\xFF");
+
+    std::size_t mismatches{0};
+    for (const auto& set : sets) {
+        Byte_class bytes{std::string_view{set}};
+        std::string_view v{text};
+        for (std::size_t pos : {std::size_t{0}, std::size_t{1}, std::size_t{37}, text.size() - 1, text.size(), std::string_view::npos}) {
+            mismatches += bytes.find_first_of(v, pos) != v.find_first_of(set, pos);
+            mismatches += bytes.find_first_not_of(v, pos) != v.find_first_not_of(set, pos);
+            mismatches += bytes.find_last_of(v, pos) != v.find_last_of(set, pos);
+            mismatches += bytes.find_last_not_of(v, pos) != v.find_last_not_of(set, pos);
+        }
+    }
+    CHECK(mismatches == 0);
+
+    constexpr auto whitespace = Byte_class::whitespace();
+    static_assert(whitespace.contains('\v') && !whitespace.contains('x'));
+    CHECK(trim(" \t\nvälue \r\n", whitespace) == "välue");
+    CHECK(trim(" \t\n", whitespace).empty());
+
+    std::vector<std::string_view> pieces;
+    tokenize_into("  a  b\tc\n", whitespace, pieces);
+    CHECK(pieces == std::vector<std::string_view>{"a", "b", "c"});
+
+    tokenize_into(" \t ", whitespace, pieces);
+    CHECK(pieces.empty());
+
+    split_into("a,b; c\td", Byte_class{std::string_view{",; \t"}}, pieces);
+    CHECK(pieces == std::vector<std::string_view>{"a", "b", "", "c", "d"});
+}
+
+
+TEST_CASE("Test views for split_once, trim and prefix", "[string, split]")
+{
+    // Header parsing without allocations
+    auto [name, value] = split_once_view<':'>("Content-Type:  text/plain; charset=utf-8 ");
+    CHECK(name == "Content-Type");
+    CHECK(trim_view<' '>(value) == "text/plain; charset=utf-8");
+    CHECK(trim_view(" \tvälue\r\n", Byte_class::whitespace()) == "välue");
+    CHECK(trim_view<' '>("   ").empty());
+
+    CHECK(split_once_view<':'>("no delimiter") == std::pair<std::string_view, std::string_view>{"no delimiter", ""});
+    CHECK(split_once_view<':'>("a:b:c") == std::pair<std::string_view, std::string_view>{"a", "b:c"});
+    CHECK(split_once_view<':'>("a:") == std::pair<std::string_view, std::string_view>{"a", ""});
+    CHECK(split_once<':'>("a:b:c") == std::pair<std::string, std::string>{"a", "b:c"});
+    CHECK(trim<' '>("  a b  ") == "a b");
+
+    std::vector<std::string> strings{"id", "", "näme"};
+    auto prefixed = prefix_flat(strings, "user.");
+    REQUIRE(prefixed.size() == 3);
+    CHECK(prefixed[0] == "user.id");
+    CHECK(prefixed[1] == "user.");
+    CHECK(prefixed[2] == "user.näme");
+    CHECK(prefixed.buffer() == "user.iduser.user.näme");
+
+    prefixed.assign(std::array<std::string_view, 1>{"x"}, "");
+    CHECK(prefixed.size() == 1);
+    CHECK(prefixed[0] == "x");
+    CHECK(prefix(strings, "user.") == std::vector<std::string>{"user.id", "user.", "user.näme"});
+}
+
+
+TEST_CASE("Test join", "[string, join]")
+{
+    std::vector<std::string> strings{"a", "", "bä"};
+    CHECK(join<','>(strings) == "a,,bä");
+    CHECK(join<','>(std::vector<std::string>{}) == "");
+    CHECK(join<','>(std::array<std::string, 2>{"x", "y"}) == "x,y");
+    CHECK(join(strings, ", ") == "a, , bä");
+    CHECK(join(std::vector<std::string_view>{"1", "2", "3"}, ", ") == "1, 2, 3");
+    CHECK(join(std::array<const char*, 1>{"only"}, ", ") == "only");
+    CHECK(joined_size(strings, ", ") == 8);
+
+    // Lazy split ranges are joined without materializing the pieces
+    CHECK(join(split_view<','>("a,b,c"), "', '") == "a', 'b', 'c");
+    CHECK(join(tokenize_view(" x  y ", Byte_class::whitespace()), "|") == "x|y");
+
+    std::string sql = "id IN ('";
+    join_into(std::vector<std::string_view>{"1", "2"}, "', '", sql);
+    sql += "')";
+    CHECK(sql == "id IN ('1', '2')");
+
+    std::vector<char> out;
+    join_to(strings, ";", std::back_inserter(out));
+    CHECK(std::string_view{out.data(), out.size()} == "a;;bä");
+}
+
+
+TEST_CASE("Test truncation", "[string, utf8, truncate]")
+{
+    CHECK(find_truncation_point("short", 10, 2) == std::string_view::npos);
+    CHECK(find_truncation_point("", 0, 0) == std::string_view::npos);
+    CHECK(find_truncation_point("äöü", 2, 1) == 4);
+    CHECK(find_truncation_point("a\nb\nc", 100, 2) == 3);
+    CHECK(truncate_by_length_and_lines("Grüße", 3, 1) == "Grü ...");
+    CHECK(truncate_by_length_and_lines("Grüße", 5, 1) == "Grüße");
+
+    // Limits are crossed inside and after the vector sized blocks
+    std::string text;
+    for (int i = 0; i != 50; ++i)
+        text += "line " + std::to_string(i) + " with ümlauts\n";
+
+    auto expected_point = [&](std::size_t max_length, std::size_t max_lines) {
+        std::size_t code_points{0};
+        std::size_t lines{1};
+        for (std::size_t i{0}; i != text.size(); ++i) {
+            code_points += is_utf8_code_point_begin(text[i]);
+            lines += text[i] == '\n';
+            if (code_points > max_length || lines > max_lines)
+                return i;
+        }
+        return std::string_view::npos;
+    };
+
+    std::size_t mismatches{0};
+    for (std::size_t max_length : {0, 1, 31, 32, 33, 100, 1000, 10000})
+        for (std::size_t max_lines : {0, 1, 2, 17, 50, 51, 100})
+            mismatches += find_truncation_point(text, max_length, max_lines) != expected_point(max_length, max_lines);
+    CHECK(mismatches == 0);
+}
+
+
+TEST_CASE("Test Utf8_index", "[string, utf8, index]")
+{
+    std::string text;
+    for (int i = 0; i != 100; ++i)
+        text += "Zeile " + std::to_string(i) + ": Grüße 😀\n";
+
+    Utf8_index index{text};
+    std::vector<std::size_t> starts;
+    Utf8_view view{text};
+    for (auto it = view.begin(); it != view.end(); ++it)
+        starts.push_back(it.position());
+
+    REQUIRE(index.length() == starts.size());
+
+    std::size_t mismatches{0};
+    for (std::size_t n{0}; n != starts.size(); ++n) {
+        mismatches += index.byte_offset(n) != starts[n];
+        mismatches += index.code_point_index(starts[n]) != n;
+    }
+    CHECK(mismatches == 0);
+    CHECK(index.byte_offset(index.length()) == text.size());
+    CHECK(index.code_point_index(text.size()) == index.length());
+
+    CHECK(index.at(10).v_ == U'r');
+    CHECK(index.at(11).v_ == U'ü');
+    CHECK(index.substr_cp(9, 5) == "Grüße");
+    CHECK(index.substr_cp(15, 2) == "😀\n");
+    CHECK(index.substr_cp(index.length() - 2) == "😀\n");
+    CHECK(index.substr_cp(index.length() + 1).empty());
+
+    // Inside a multi byte sequence belongs to its code point
+    CHECK(index.code_point_index(starts[11] + 1) == 11);
+
+    auto it = index.iterator_at(index.length());
+    --it;
+    CHECK(it->v_ == U'\n');
+    --it;
+    CHECK(it->v_ == U'😀');
+
+    // Ill-formed sequences count like the iterator steps over them
+    std::string ill_formed = "a\xE2\x82" "b\x80\x80\x80\x80" "c";
+    Utf8_index ill_formed_index{ill_formed};
+    CHECK(ill_formed_index.length() == 8);
+    CHECK(ill_formed_index.at(1).v_ == 0xFFFDu);
+    CHECK(ill_formed_index.substr_cp(2, 1) == "b");
+
+    auto back = ill_formed_index.iterator_at(7);
+    --back;
+    CHECK(back.position() == 7);
+    --back;
+    CHECK(back.position() == 6);
+}
+
+
+TEST_CASE("Test streaming", "[string, utf8, stream]")
+{
+    std::string text = "Grüße aus Köln 😀, STRAẞE\n\xE2\x82 ende";
+
+    // Every split into two chunks, sequences are cut anywhere
+    std::size_t mismatches{0};
+    for (std::size_t cut{0}; cut <= text.size(); ++cut) {
+        std::string_view first = std::string_view{text}.substr(0, cut);
+        std::string_view second = std::string_view{text}.substr(cut);
+
+        Utf8_stream_decoder decoder;
+        std::string joined;
+        auto on_piece = [&](std::string_view piece) { joined += piece; };
+        decoder.feed(first, on_piece);
+        decoder.feed(second, on_piece);
+        decoder.finish(on_piece);
+        mismatches += joined != text;
+
+        Utf8_stream_lower_caser lower_caser;
+        std::string lower;
+        lower_caser.feed(first, lower);
+        lower_caser.feed(second, lower);
+        lower_caser.finish(lower);
+        mismatches += lower != as_lower_cased_string(text);
+
+        Utf8_stream_validator validator;
+        validator.feed(first);
+        validator.feed(second);
+        mismatches += validator.finish().error_offset != validate_utf8(text).error_offset;
+
+        mismatches += !icontains_stream(std::vector<std::string_view>{first, second}, "köln 😀, straße");
+        mismatches += icontains_stream(std::vector<std::string_view>{first, second}, "köln 😀😀");
+    }
+    CHECK(mismatches == 0);
+
+    // A sequence cut off by the end of the stream is an error
+    Utf8_stream_validator validator;
+    CHECK(validator.feed("ab\xF0\x9F"));
+    CHECK(validator.finish().error_offset == 2);
+
+    Utf8_stream_decoder decoder;
+    std::size_t pieces{0};
+    decoder.feed("\xF0", [&](std::string_view) { ++pieces; });
+    decoder.feed("\x9F\x98", [&](std::string_view) { ++pieces; });
+    CHECK(pieces == 0);
+    CHECK(decoder.pending_size() == 3);
+    decoder.feed("\x80", [&](std::string_view piece) { CHECK(piece == "😀"); ++pieces; });
+    CHECK(pieces == 1);
+
+    CHECK(icontains_stream(std::vector<std::string>{}, ""));
+    CHECK_FALSE(icontains_stream(std::vector<std::string>{}, "a"));
+}
+
+
+TEST_CASE("Test icase_grep", "[string, utf8, grep]")
+{
+    std::string text = "Erste Zeile\nGRÜSSE aus Köln, grüsse\n\nköln am Rhein";
+
+    auto matches = icase_grep(text, Icase_pattern{"grüsse"});
+    REQUIRE(matches.size() == 1);
+    CHECK(matches[0].line_number == 2);
+    CHECK(matches[0].line_begin == 12);
+    CHECK(text.substr(matches[0].match_begin, matches[0].match_end - matches[0].match_begin) == "GRÜSSE");
+
+    matches = icase_grep(text, Icase_pattern{"KÖLN"}, Execution::parallel);
+    REQUIRE(matches.size() == 2);
+    CHECK(matches[0].line_number == 2);
+    CHECK(matches[1].line_number == 4);
+    CHECK(matches[1].match_begin == matches[1].line_begin);
+
+    CHECK(icase_grep(text, Icase_pattern{""}).size() == 4);
+    CHECK(icase_grep(text, Icase_pattern{"zeile\ngrüsse"}).empty());
+    CHECK(icase_grep("", Icase_pattern{"a"}).empty());
+
+    // Windows smaller than a line grow to the end of the line
+    std::string path = "audaki-u8string-grep-test.txt";
+    std::string file_text;
+    for (int i = 0; i != 1000; ++i)
+        file_text += (i % 10 ? "line " : "LINE ÄÖÜ ") + std::to_string(i) + "\n";
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    REQUIRE(file);
+    std::fwrite(file_text.data(), 1, file_text.size(), file);
+    std::fclose(file);
+
+    auto file_matches = icase_grep_file(path.c_str(), Icase_pattern{"äöü"}, Execution::parallel, 7);
+    REQUIRE(file_matches);
+    CHECK(file_matches->size() == 100);
+    CHECK(file_matches->back().line_number == 991);
+
+    auto all_at_once = icase_grep(file_text, Icase_pattern{"äöü"});
+    std::size_t mismatches{0};
+    for (std::size_t i{0}; i != all_at_once.size(); ++i)
+        mismatches += all_at_once[i].match_begin != (*file_matches)[i].match_begin;
+    CHECK(mismatches == 0);
+    std::remove(path.c_str());
+
+    CHECK_FALSE(icase_grep_file("does/not/exist", Icase_pattern{"a"}));
+
+    // Texts of several chunks are searched on the shared pool
+    std::string large_text;
+    while (large_text.size() < (std::size_t{8} << 20))
+        large_text += file_text;
+    auto parallel_matches = icase_grep(large_text, Icase_pattern{"äöü 99"}, Execution::parallel);
+    auto sequential_matches = icase_grep(large_text, Icase_pattern{"äöü 99"});
+    REQUIRE(parallel_matches.size() == sequential_matches.size());
+    mismatches = 0;
+    for (std::size_t i{0}; i != parallel_matches.size(); ++i)
+        mismatches += parallel_matches[i].line_number != sequential_matches[i].line_number || parallel_matches[i].match_begin != sequential_matches[i].match_begin;
+    CHECK(mismatches == 0);
+    CHECK(parallel_matches.back().line_number == large_text.size() / file_text.size() * 1000 - 9);
+}
+
+
+TEST_CASE("Test batch APIs", "[string, utf8, batch]")
+{
+    std::vector<std::string> storage;
+    for (int i = 0; i != 5000; ++i)
+        storage.push_back((i % 7 ? "Straße " : "GRÜSSE aus KÖLN ") + std::to_string(i));
+    std::vector<std::string_view> strings{storage.begin(), storage.end()};
+
+    Thread_pool pool{4};
+    CHECK(pool.thread_count() == 4);
+
+    std::vector<std::string> lowered(strings.size(), "stale");
+    batch_to_lower(strings, lowered, pool);
+    std::size_t mismatches{0};
+    for (std::size_t i{0}; i != strings.size(); ++i)
+        mismatches += lowered[i] != as_lower_cased_string(strings[i]);
+    CHECK(mismatches == 0);
+
+    std::vector<uint64_t> matches(batch_bitmap_size(strings.size()), ~uint64_t{0});
+    batch_icontains(strings, Icase_pattern{"grüsse aus"}, matches, pool);
+    REQUIRE(matches.size() == (strings.size() + 63) / 64);
+    mismatches = 0;
+    for (std::size_t i{0}; i != strings.size(); ++i)
+        mismatches += ((matches[i / 64] >> (i % 64)) & 1) != (i % 7 == 0);
+    CHECK(mismatches == 0);
+    CHECK(matches.back() >> (strings.size() % 64) == 0);
+
+    // The strings themselves instead of views of them
+    std::vector<uint64_t> parallel_matches(matches.size());
+    batch_icontains(storage, Icase_pattern{"grüsse aus"}, parallel_matches, Execution::parallel);
+    CHECK(parallel_matches == matches);
+
+    batch_iequal(strings, "sTRASSE 4999", matches);
+    CHECK(std::accumulate(matches.begin(), matches.end(), uint64_t{0}) == 0);
+    batch_iequal(storage, "STRAẞE 4999", matches);
+    CHECK(matches.back() == uint64_t{1} << (4999 % 64));
+    CHECK(std::accumulate(matches.begin(), matches.end() - 1, uint64_t{0}) == 0);
+
+    std::vector<uint64_t> no_matches;
+    batch_iequal({}, "a", no_matches, pool);
+    CHECK(no_matches.empty());
+
+    // Custom executors see every task once, batches started by tasks of the pool run inline
+    struct Counting_executor : Executor {
+        void run(std::size_t task_count, const std::function<void(std::size_t)>& task) override
+        {
+            for (std::size_t i = task_count; i--;)
+                task(i);
+            tasks += task_count;
+        }
+
+        std::size_t tasks{0};
+    };
+    Counting_executor counting;
+    batch_to_lower(strings, lowered, counting);
+    CHECK(counting.tasks == (strings.size() + batch_grain_size - 1) / batch_grain_size);
+    CHECK(lowered[4999] == "straße 4999");
+
+    std::vector<std::vector<std::string>> nested(8, std::vector<std::string>(strings.size()));
+    pool.run(nested.size(), [&](std::size_t i) { batch_to_lower(strings, nested[i], pool); });
+    mismatches = 0;
+    for (const auto& out : nested)
+        mismatches += out != lowered;
+    CHECK(mismatches == 0);
+
+    // Exceptions of tasks reach the caller and the pool stays usable
+    std::atomic<std::size_t> started{0};
+    auto throwing = [&](std::size_t i) {
+        ++started;
+        if (i == 3)
+            throw std::runtime_error{"task 3"};
+    };
+    CHECK_THROWS_WITH(pool.run(1000, throwing), "task 3");
+    CHECK(started.load() <= 1000);
+    CHECK_THROWS_AS(Thread_pool{1}.run(8, throwing), std::runtime_error);
+
+    started = 0;
+    pool.run(1000, [&](std::size_t) { ++started; });
+    CHECK(started.load() == 1000);
+}
+
+
+TEST_CASE("Test SIMD dispatch", "[string, utf8, simd]")
+{
+    std::vector<std::string> texts{
+        "",
+        "Grüße aus Köln, STRAẞE und Straße. " + std::string(100, 'a'),
+        std::string(70, 'x') + "\xE2\x82" + std::string(40, 'y'),
+        std::string(61, 'q') + "😀 Ünïcödé 日本語\n",
+        "ÄÖÜ\xED\xA0\x80 and more text behind the surrogate to fill a few blocks of every width"};
+
+    auto results = [&] {
+        std::vector<std::string> out;
+        for (const auto& text : texts) {
+            out.push_back(as_lower_cased_string(text) + as_upper_cased_string(text));
+            out.push_back(std::to_string(validate_utf8(text).error_offset));
+            out.push_back(std::to_string(icontains(text, "STRASSE")) + std::to_string(icontains(text, "YYYYY")));
+            out.push_back(std::to_string(u8_icompare3(text, as_upper_cased_string(text))));
+            out.push_back(std::to_string(find_truncation_point(text, 50, 2)) + " " + std::to_string(icase_grep(text, Icase_pattern{"ü"}).size()));
+
+            // Both the compared bytes and the nibble lookup of Byte_class
+            for (Byte_class bytes : {Byte_class::whitespace(), Byte_class{std::string_view{"0123456789,.;:!?\xBC"}}}) {
+                out.push_back(std::to_string(bytes.find_first_of(text)) + " " + std::to_string(bytes.find_first_not_of(text, 3)));
+                out.push_back(std::to_string(bytes.find_last_of(text)) + " " + std::to_string(bytes.find_last_not_of(text, 90)));
+            }
+
+            Utf8_index index{text};
+            out.push_back(std::to_string(index.length()) + " " + std::to_string(index.byte_offset(index.length() * 2 / 3)));
+            out.push_back(std::string{index.substr_cp(index.length() / 3, 40)});
+        }
+        return out;
+    };
+
+    Simd_level initial = simd_level();
+    CHECK(initial <= max_simd_level());
+
+    REQUIRE(set_simd_level(Simd_level::scalar));
+    CHECK(simd_level() == Simd_level::scalar);
+    auto expected = results();
+
+    for (auto level : {Simd_level::sse2, Simd_level::sse42, Simd_level::avx2}) {
+        if (!set_simd_level(level)) {
+            CHECK(level > max_simd_level());
+            CHECK(simd_level() != level);
+            continue;
+        }
+
+        CHECK(results() == expected);
+    }
+
+    REQUIRE(set_simd_level(initial));
+}
+
+
+TEST_CASE("Test transcoding", "[string, utf8, transcode]")
+{
+    std::string latin1 = "Gr\xFC\xDF" "e aus K\xF6ln " + std::string(40, 'x') + " \xC4\xD6\xDC\xFF";
+    std::string utf8 = "Grüße aus Köln " + std::string(40, 'x') + " ÄÖÜÿ";
+
+    CHECK(latin1_to_utf8_size(latin1) == utf8.size());
+    CHECK(latin1_to_utf8(latin1) == utf8);
+    CHECK(fits_latin1(utf8));
+    CHECK(utf8_to_latin1_size(utf8) == latin1.size());
+    CHECK(utf8_to_latin1(utf8) == latin1);
+
+    std::string windows1252 = "\x80 \x84" "Anf\xFChrung\x93 \x8A\x9E \x81";
+    CHECK(windows1252_to_utf8(windows1252) == "€ „Anführung“ Šž \xC2\x81");
+    CHECK(windows1252_to_utf8_size(windows1252) == windows1252_to_utf8(windows1252).size());
+
+    // ẞ and € are outside of Latin-1, the error is at their offset
+    std::string out(32, '\0');
+    auto result = utf8_to_latin1("Maß STRAẞE", out.data());
+    CHECK_FALSE(result);
+    CHECK(result.error_offset == 9);
+    CHECK(out.substr(0, result.written) == "Ma\xDF STRA");
+    CHECK_FALSE(fits_latin1("STRAẞE"));
+    CHECK_FALSE(fits_latin1("Gr\xFC\xDF" "e"));
+    CHECK_FALSE(utf8_to_latin1("20 €"));
+
+    std::string mixed = "Grüße " + std::string(50, 'a') + " 😀 €uro 日本語";
+    std::u16string utf16 = u"Grüße " + std::u16string(50, u'a') + u" 😀 €uro 日本語";
+    std::u32string utf32 = U"Grüße " + std::u32string(50, U'a') + U" 😀 €uro 日本語";
+
+    CHECK(utf8_to_utf16_size(mixed) == utf16.size());
+    CHECK(utf8_to_utf16(mixed) == utf16);
+    CHECK(utf16_to_utf8_size(utf16) == mixed.size());
+    CHECK(utf16_to_utf8(utf16) == mixed);
+    CHECK(utf8_to_utf32_size(mixed) == utf32.size());
+    CHECK(utf8_to_utf32(mixed) == utf32);
+    CHECK(utf32_to_utf8_size(utf32) == mixed.size());
+    CHECK(utf32_to_utf8(utf32) == mixed);
+    CHECK_FALSE(fits_latin1(utf16));
+    CHECK(fits_latin1(std::u16string_view{u"Grüße"}));
+    CHECK(fits_latin1(std::u32string_view{U"Köln"}));
+    CHECK(fits_latin1(std::u16string(70, u'ÿ') + u"Köln"));
+    CHECK_FALSE(fits_latin1(std::u16string(70, u'ÿ') + u"€"));
+    CHECK(fits_latin1(std::u32string(70, U'ÿ') + U"Köln"));
+    CHECK_FALSE(fits_latin1(std::u32string(70, U'ÿ') + U"\u0100"));
+
+    // Errors stop the conversion after the last complete code point
+    std::u16string converted(64, u'\0');
+    result = utf8_to_utf16("ab\xC3\x28", converted.data());
+    CHECK(result.error_offset == 2);
+    CHECK(result.written == 2);
+    CHECK_FALSE(utf8_to_utf32("\xED\xA0\x80"));
+
+    std::u16string unpaired = u"ab";
+    unpaired += char16_t{0xD83D};
+    unpaired += u"cd";
+    result = utf16_to_utf8(unpaired, out.data());
+    CHECK(result.error_offset == 2);
+    CHECK(out.substr(0, result.written) == "ab");
+    CHECK_FALSE(utf16_to_utf8(std::u16string(1, char16_t{0xDC00})));
+    CHECK_FALSE(utf32_to_utf8(std::u32string(1, char32_t{0x110000})));
+    CHECK_FALSE(utf32_to_utf8(std::u32string(1, char32_t{0xD800})));
+
+    CHECK(utf8_to_utf16("") == u"");
+    CHECK(latin1_to_utf8("").empty());
+}
+
+
+TEST_CASE("Test accent insensitive folding", "[string, utf8, accent]")
+{
+    CHECK(fold_to_ascii_key("Müller") == "muller");
+    CHECK(fold_to_ascii_key("Crème Brûlée") == "creme brulee");
+    CHECK(fold_to_ascii_key("STRAẞE Straße") == "strasse strasse");
+    CHECK(fold_to_ascii_key("Æsir Þór ÿ") == "aesir thor y");
+    CHECK(fold_to_ascii_key("6 ÷ 3 €") == "6 ÷ 3 €");
+    CHECK(fold_to_ascii_key("a\xFF") == "a\xEF\xBF\xBD");
+    CHECK(fold_to_ascii_key(*make_validated_utf8_view("Ærø")) == "aero");
+
+    CHECK(u8_accent_iequal("Müller", "MULLER"));
+    CHECK(u8_accent_iequal("creme", "Crème"));
+    CHECK(u8_accent_iequal("Straße", "STRASSE"));
+    CHECK(u8_accent_iequal("strasse", "STRAẞE"));
+    CHECK_FALSE(u8_accent_iequal("Müller", "Mueller"));
+    CHECK_FALSE(u8_accent_iequal("Strase", "Straße"));
+    CHECK(u8_accent_iequal(*make_validated_utf8_view("Çà"), *make_validated_utf8_view("ca")));
+
+    // The folded keys order, the shorter one first on a common prefix
+    CHECK(u8_accent_iless("Émile", "Eva"));
+    CHECK(u8_accent_iless("Straße", "Strasser"));
+    CHECK(u8_accent_iless("Äa", "ab"));
+    CHECK_FALSE(u8_accent_iless("ab", "Äa"));
+    CHECK_FALSE(u8_accent_iless("Müller", "muller"));
+    CHECK(u8_accent_icompare3("Sœur", "Soeur") > 0);
+    CHECK(u8_accent_icompare3("daß", "DASS") == 0);
+
+    CHECK(accent_icontains("Crème Brûlée", "creme"));
+    CHECK(accent_icontains("Crème Brûlée", "BRULEE"));
+    CHECK(accent_icontains("Die Straße", "asse"));
+    CHECK(accent_icontains("Ärger", "a"));
+    CHECK(accent_icontains("Ärger", ""));
+    CHECK_FALSE(accent_icontains("Crème", "cremes"));
+    CHECK(accent_icontains(*make_validated_utf8_view("Das Café"), *make_validated_utf8_view("CAFE")));
+
+    // Comparison and search agree with the keys across the search chunk size
+    std::string long_text = std::string(5000, 'x') + "Ångström " + std::string(5000, 'y');
+    CHECK(accent_icontains(long_text, "xangstrom y"));
+    CHECK(accent_icontains(long_text + "Crème", std::string(300, 'Y') + "CREME"));
+    CHECK(fold_to_ascii_key(long_text).find(fold_to_ascii_key("XÅNGSTRÖM")) == 4999);
+
+    std::vector<std::string> names{"Zoë", "zoe", "Ångström", "angstrom", "Éclair", "Eclair", "Ölfass", "olfass", "Œuvre", "Straße", "strasse"};
+    for (const auto& a : names) {
+        for (const auto& b : names) {
+            std::string key_a = fold_to_ascii_key(a);
+            std::string key_b = fold_to_ascii_key(b);
+            CHECK(u8_accent_iequal(a, b) == (key_a == key_b));
+            CHECK(u8_accent_iless(a, b) == (key_a < key_b));
+            CHECK(accent_icontains(a, b) == (key_a.find(key_b) != std::string::npos));
+        }
+    }
+}
+
+
+TEST_CASE("Test case insensitive edit distance", "[string, utf8, fuzzy]")
+{
+    constexpr std::size_t npos = std::string_view::npos;
+
+    CHECK(u8_iedit_distance("kitten", "sitting") == 3);
+    CHECK(u8_iedit_distance("Müller", "MÜLLER") == 0);
+    CHECK(u8_iedit_distance("Müller", "Mueller") == 2);
+    CHECK(u8_iedit_distance("STRAẞE", "straße") == 0);
+    CHECK(u8_iedit_distance("日本語", "日本") == 1);
+    CHECK(u8_iedit_distance("", "Grüße") == 5);
+    CHECK(u8_iedit_distance("Grüße", "") == 5);
+    CHECK(u8_iedit_distance("", "") == 0);
+    CHECK(u8_iedit_distance("a\xFF", "a\xFE") == 0);
+
+    // Transpositions count once with damerau, unless the transposed code points are edited again
+    CHECK(u8_iedit_distance("Jürgen", "Jrügen") == 2);
+    CHECK(u8_iedit_distance("Jürgen", "JRÜgen", npos, Edit_distance::damerau) == 1);
+    CHECK(u8_iedit_distance("ca", "abc", npos, Edit_distance::damerau) == 3);
+
+    CHECK(u8_iedit_distance("kitten", "sitting", 3) == 3);
+    CHECK(u8_iedit_distance("kitten", "sitting", 2) == npos);
+    CHECK(u8_iedit_distance("a", std::string(1000, 'b'), 10) == npos);
+    CHECK(u8_iedit_distance(std::string(1000, 'b'), "a", 10) == npos);
+
+    // Long strings take several words per column
+    std::string long1;
+    std::string long2;
+    for (int i = 0; i != 50; ++i) {
+        long1 += "Größe " + std::to_string(i) + " ";
+        long2 += "GRÖSSE " + std::to_string(i) + " ";
+    }
+    CHECK(u8_iedit_distance(long1, long2) == 100);
+    CHECK(u8_iedit_distance(long1, long2, 99) == npos);
+    CHECK(u8_iedit_distance(long1 + "ab", long2 + "ba", npos, Edit_distance::damerau) == 101);
+
+    Fuzzy_pattern pattern{"Schmidt"};
+    CHECK(pattern.code_point_count() == 7);
+    CHECK(pattern.distance("SCHMITT") == 1);
+    CHECK(pattern.distance("Schmied", 1) == npos);
+    CHECK(Fuzzy_pattern{long1}.distance(long2) == 100);
+    CHECK(Fuzzy_pattern{"Jürgen", Edit_distance::damerau}.distance("Jrügen") == 1);
+    CHECK(Fuzzy_pattern{""}.distance("Öl") == 2);
+
+    std::vector<std::string> names;
+    for (int i = 0; i != 3000; ++i)
+        names.push_back(i % 3 == 0 ? "Schmitt " + std::to_string(i) : "Müller " + std::to_string(i));
+
+    Fuzzy_pattern name_pattern{"SCHMIDT 42"};
+    std::vector<std::size_t> distances(names.size());
+    batch_iedit_distance(names, name_pattern, 2, distances);
+    std::vector<std::size_t> parallel_distances(names.size());
+    batch_iedit_distance(names, name_pattern, 2, parallel_distances, Execution::parallel);
+    CHECK(parallel_distances == distances);
+    CHECK(distances[42] == 1);
+    CHECK(distances[1] == npos);
+    for (std::size_t i = 0; i < names.size(); i += 97)
+        CHECK(distances[i] == u8_iedit_distance(names[i], "SCHMIDT 42", 2));
+}
+
+
+TEST_CASE("Test case insensitive prefix index", "[string, utf8, prefix_index]")
+{
+    std::vector<std::string_view> cities{"München", "Mülheim", "MUNSTER", "Münster", "Mainz", "Magdeburg", "Straßburg", "STRALSUND", "Ulm", "münchberg"};
+    std::vector<uint32_t> population{1500000, 170000, 5000, 315000, 220000, 240000, 290000, 60000, 126000, 10000};
+
+    Icase_prefix_index index{cities, population};
+    CHECK(index.size() == cities.size());
+    CHECK(index.count("mü") == 4);
+    CHECK(index.count("MÜNCH") == 2);
+    CHECK(index.count("strass") == 0);
+    CHECK(index.count("STRAẞ") == 1);
+    CHECK(index.count("") == cities.size());
+    CHECK(index.count("x") == 0);
+
+    auto top = index.top_k("mü", 3);
+    REQUIRE(top.size() == 3);
+    CHECK(top[0].entry == "München");
+    CHECK(top[0].index == 0);
+    CHECK(top[0].weight == 1500000);
+    CHECK(top[1].entry == "Münster");
+    CHECK(top[2].entry == "Mülheim");
+    CHECK(index.top_k("M", 100).size() == 7);
+    CHECK(index.top_k("Ulm", 0).empty());
+    CHECK(index.top_k("Zwickau", 5).empty());
+
+    // Without weights the completions are in u8_iless order
+    Icase_prefix_index unweighted{cities};
+    auto sorted = unweighted.top_k("m", 4);
+    REQUIRE(sorted.size() == 4);
+    CHECK(sorted[0].entry == "Magdeburg");
+    CHECK(sorted[1].entry == "Mainz");
+    CHECK(sorted[2].entry == "MUNSTER");
+    CHECK(sorted[3].entry == "Mülheim");
+
+    // A copy of the buffer, as if read from a file, works in place
+    std::string_view buffer = index.buffer();
+    std::vector<uint64_t> file((buffer.size() + 7) / 8);
+    std::memcpy(file.data(), buffer.data(), buffer.size());
+    auto loaded = Icase_prefix_index::view({reinterpret_cast<const char*>(file.data()), buffer.size()});
+    REQUIRE(loaded);
+    CHECK(loaded->count("mü") == 4);
+    CHECK(loaded->top_k("STR", 2)[0].entry == "Straßburg");
+    CHECK(loaded->buffer().data() == reinterpret_cast<const char*>(file.data()));
+
+    CHECK_FALSE(Icase_prefix_index::view({reinterpret_cast<const char*>(file.data()), buffer.size() - 8}));
+    CHECK_FALSE(Icase_prefix_index::view({reinterpret_cast<const char*>(file.data()) + 8, buffer.size() - 8}));
+    CHECK_FALSE(Icase_prefix_index::view("not an index"));
+    reinterpret_cast<char*>(file.data())[0] = 'X';
+    CHECK_FALSE(Icase_prefix_index::view({reinterpret_cast<const char*>(file.data()), buffer.size()}));
+
+    // Parallel builds give the same buffer
+    std::vector<std::string> names;
+    std::vector<uint32_t> weights;
+    for (uint32_t i = 0; i != 5000; ++i) {
+        names.push_back((i % 2 ? "Straße " : "STRASSE ") + std::to_string(i));
+        weights.push_back(i * 7919 % 5000);
+    }
+    std::vector<std::string_view> views(names.begin(), names.end());
+    Icase_prefix_index sequential_index{views, weights};
+    Icase_prefix_index parallel_index{views, weights, Execution::parallel};
+    CHECK(sequential_index.buffer() == parallel_index.buffer());
+    CHECK(parallel_index.count("STR") == 5000);
+    CHECK(parallel_index.count("straße 1") == 556);
+    CHECK(parallel_index.count("strasse 1") == 555);
+
+    auto best = parallel_index.top_k("straße", 10);
+    REQUIRE(best.size() == 10);
+    for (std::size_t i = 1; i != best.size(); ++i)
+        CHECK(best[i - 1].weight >= best[i].weight);
+    CHECK(best[0].weight == 4999);
+    CHECK(names[best[0].index] == best[0].entry);
+
+    CHECK(Icase_prefix_index{std::vector<std::string_view>{}}.top_k("", 5).empty());
+}
@@ -0,0 +1,392 @@
+#include "audaki/u8string.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+
+
+/**
+ * Benchmarks of the public API on generated Western European text, build with CMAKE_BUILD_TYPE=Release.
+ *
+ *     audaki-u8string-bench [--filter TEXT] [--min-time MS] [--json FILE]
+ *
+ * Every benchmark runs on every corpus at several sizes and reports ns/op, bytes/s of input and heap
+ * allocations per op. The corpora come from a fixed seed, so runs of different versions see the same bytes
+ * and the JSON output can be compared across them. AUDAKI_U8STRING_SIMD_LEVEL selects the kernels to measure.
+ */
+
+
+
+namespace {
+
+std::atomic<std::size_t> allocation_count{0};
+
+}
+
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc{};
+}
+
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+
+namespace {
+
+/**
+ * Keep the optimizer from dropping computations whose result isn't used.
+ */
+template <typename T>
+void keep(const T& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+
+/**
+ * xorshift64, the same sequence on every platform.
+ */
+class Random {
+public:
+
+    std::size_t below(std::size_t n) noexcept
+    {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return static_cast<std::size_t>(state_ % n);
+    }
+
+private:
+
+    uint64_t state_{0x9E37'79B9'7F4A'7C15u};
+};
+
+
+struct Corpus {
+    const char* name;
+    std::vector<std::string_view> words;
+};
+
+
+const std::vector<Corpus>& corpora()
+{
+    static const std::vector<Corpus> corpora{
+        {"ascii", {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "Lorem", "ipsum", "dolor", "sit",
+            "amet", "Invoice", "Customer", "order", "delivered", "2024-05-17", "EUR", "12.50", "Berlin", "Paris"}},
+        {"western", {"Größe", "Müller", "Übermäßig", "Ärger", "Öl", "Bäckerei", "Grüße", "aus", "Köln", "und",
+            "français", "élève", "garçon", "Noël", "œuvre", "château", "déjà", "naïve", "Crème", "brûlée", "à",
+            "la", "Zürich", "Ça", "va", "Église", "straße", "der", "die", "das"}},
+        {"sharp_s", {"STRAẞE", "Straße", "ẞ", "Maß", "Fuß", "GROẞ", "Schloß", "FUẞBALL", "Gruß", "weiß", "ß",
+            "Meißen", "GIEẞEN"}},
+        {"emoji", {"😀", "👍🏽", "🎉", "𝄞", "日本語", "Ünïcödé", "🇩🇪", "€", "Grüße", "🍺🥨", "Ω", "→", "ok"}},
+        {"malformed", {"Größe", "\xC3", "Müller", "\xFF\xFE", "Köln", "\xE2\x82", "élève", "\xED\xA0\x80",
+            "\xC0\xAF", "straße", "\x80\x80", "Noël", "\xF4\x90\x80\x80", "ẞ"}},
+    };
+
+    return corpora;
+}
+
+
+/**
+ * size bytes of words separated by spaces with a line break every twelve words. The end is cut at a code point
+ * boundary, except in malformed text.
+ */
+std::string make_text(const Corpus& corpus, std::size_t size)
+{
+    Random random;
+    std::string text;
+    for (std::size_t word_count{1}; text.size() < size; ++word_count) {
+        text += corpus.words[random.below(corpus.words.size())];
+        text += word_count % 12 ? ' ' : '\n';
+    }
+
+    bool is_malformed = std::string_view{corpus.name} == "malformed";
+    while (!is_malformed && size && !is_utf8_code_point_begin(text[size]))
+        --size;
+    text.resize(size);
+
+    return text;
+}
+
+
+std::vector<std::string_view> lines_of(std::string_view text)
+{
+    std::vector<std::string_view> lines;
+    split_into<'\n'>(text, lines);
+    return lines;
+}
+
+
+struct Result {
+    std::string benchmark;
+    std::string corpus;
+    std::size_t size;
+    std::size_t iterations;
+    double ns_per_op;
+    double bytes_per_second;
+    double allocations_per_op;
+};
+
+
+struct Options {
+    std::string_view filter;
+    std::chrono::nanoseconds min_time{std::chrono::milliseconds{100}};
+    const char* json_path{nullptr};
+};
+
+
+/**
+ * Runs a benchmark with doubling iteration counts until a round takes min_time.
+ */
+template <typename Body>
+Result measure(const Options& options, std::string_view benchmark, const char* corpus, std::size_t size, Body&& body)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Warm up caches and lazily built tables
+    body();
+
+    for (std::size_t iterations{1};; iterations *= 2) {
+        std::size_t allocations = allocation_count.load(std::memory_order_relaxed);
+        auto begin = Clock::now();
+        for (std::size_t i{0}; i != iterations; ++i)
+            body();
+        auto elapsed = Clock::now() - begin;
+        allocations = allocation_count.load(std::memory_order_relaxed) - allocations;
+
+        if (elapsed >= options.min_time || iterations >= (std::size_t{1} << 40)) {
+            double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            double ns_per_op = ns / static_cast<double>(iterations);
+            return {
+                std::string{benchmark},
+                corpus,
+                size,
+                iterations,
+                ns_per_op,
+                ns_per_op > 0 ? static_cast<double>(size) * 1e9 / ns_per_op : 0,
+                static_cast<double>(allocations) / static_cast<double>(iterations)};
+        }
+    }
+}
+
+
+/**
+ * All benchmarks on one text, which is the haystack, the subject of case mapping or the source of the lines.
+ */
+class Suite {
+public:
+
+    Suite(const Options& options, const char* corpus, const std::string& text, std::vector<Result>& results):
+        options_{options}, corpus_{corpus}, text_{text}, results_{results}
+    {
+    }
+
+    template <typename Body>
+    void add(std::string_view benchmark, Body&& body)
+    {
+        if (benchmark.find(options_.filter) == std::string_view::npos)
+            return;
+
+        results_.push_back(measure(options_, benchmark, corpus_, text_.size(), body));
+        const auto& result = results_.back();
+        std::printf("%-32s %-10s %8zu %14.1f ns/op %10.1f MB/s %8.2f allocs/op\n",
+            result.benchmark.c_str(), corpus_, result.size, result.ns_per_op, result.bytes_per_second / 1e6,
+            result.allocations_per_op);
+        std::fflush(stdout);
+    }
+
+    void run_all()
+    {
+        const std::string& text = text_;
+        std::string upper = as_upper_cased_string(text);
+        std::string buffer;
+        std::vector<std::string_view> pieces;
+        std::vector<std::string_view> lines = lines_of(text);
+        std::vector<std::string> lowered_lines(lines.size());
+        std::vector<uint64_t> bitmap(batch_bitmap_size(lines.size()));
+        std::vector<std::size_t> distances(lines.size());
+        Icase_pattern pattern{"Ölförderung"};
+        Fuzzy_pattern fuzzy_pattern{"Ölförderung"};
+        Icase_pattern_set pattern_set{"Ölförderung", "Zugspitze", "Mont Blanc", "Dürüm"};
+        Byte_class blanks{" \n"};
+
+        // Case mapping
+        add("as_lower_cased_string", [&] { keep(as_lower_cased_string(text)); });
+        add("as_upper_cased_string", [&] { keep(as_upper_cased_string(text)); });
+        add("lower_cased_size", [&] { keep(lower_cased_size(text)); });
+        add("to_lower_into", [&] { buffer.clear(); to_lower_into(text, buffer); keep(buffer); });
+        add("to_upper_into", [&] { buffer.clear(); to_upper_into(text, buffer); keep(buffer); });
+        add("to_lower_in_place", [&] { buffer.assign(text); to_lower_in_place(buffer); keep(buffer); });
+        add("to_lower_copy", [&] { buffer.clear(); to_lower_copy(text, std::back_inserter(buffer)); keep(buffer); });
+        add("make_isort_key", [&] { keep(make_isort_key(text)); });
+
+        // Validation and decoding
+        add("validate_utf8", [&] { keep(validate_utf8(text)); });
+        add("make_validated_utf8_view", [&] { keep(make_validated_utf8_view(text)); });
+        add("Utf8_view iteration", [&] {
+            uint32_t sum{0};
+            for (auto code_point : Utf8_view{text})
+                sum += code_point.v_;
+            keep(sum);
+        });
+        add("Utf8_index build", [&] { keep(Utf8_index{text}.length()); });
+        Utf8_index index{text};
+        add("Utf8_index at", [&] { keep(index.at(index.length() / 2)); });
+
+        // Case insensitive comparison
+        add("u8_iequal", [&] { keep(u8_iequal(text, upper)); });
+        add("u8_iless", [&] { keep(u8_iless(text, upper)); });
+        add("u8_icompare3", [&] { keep(u8_icompare3(text, upper)); });
+        add("u8_ihash", [&] { keep(u8_ihash(text)); });
+
+        // Case insensitive search, the needles aren't in the corpora so the whole text is searched
+        add("icontains", [&] { keep(icontains(text, "Ölförderung")); });
+        add("Icase_pattern::contains", [&] { keep(pattern.contains(text)); });
+        add("Icase_pattern::find_all", [&] { keep(pattern.find_all(text)); });
+        add("Icase_pattern_set::contains_any", [&] { keep(pattern_set.contains_any(text)); });
+        add("icase_grep", [&] { keep(icase_grep(text, pattern)); });
+        add("icontains_stream", [&] { keep(icontains_stream(lines, "Ölförderung")); });
+        add("Fuzzy_pattern::distance", [&] { keep(fuzzy_pattern.distance(text)); });
+
+        // Splitting, trimming and joining
+        add("split_into", [&] { pieces.clear(); split_into<' '>(text, pieces); keep(pieces); });
+        add("tokenize_into", [&] { pieces.clear(); tokenize_into(text, blanks, pieces); keep(pieces); });
+        add("trim_view", [&] { keep(trim_view(text, blanks)); });
+        add("join", [&] { keep(join(lines, "\n")); });
+        add("find_truncation_point", [&] { keep(find_truncation_point(text, text.size() / 2, 1000)); });
+
+        // Streaming
+        add("Utf8_stream_lower_caser", [&] {
+            Utf8_stream_lower_caser caser;
+            buffer.clear();
+            for (auto line : lines)
+                caser.feed(line, buffer);
+            caser.finish(buffer);
+            keep(buffer);
+        });
+        add("Utf8_stream_validator", [&] {
+            Utf8_stream_validator validator;
+            for (auto line : lines)
+                validator.feed(line);
+            keep(validator.finish());
+        });
+
+        // Many strings
+        add("u8_isort_order", [&] { keep(u8_isort_order(lines)); });
+        add("batch_to_lower", [&] { batch_to_lower(lines, lowered_lines); keep(lowered_lines); });
+        add("batch_icontains", [&] { batch_icontains(lines, pattern, bitmap); keep(bitmap); });
+        add("batch_iequal", [&] { batch_iequal(lines, "Größe", bitmap); keep(bitmap); });
+        add("u8_iedit_distance", [&] {
+            std::size_t sum{0};
+            for (std::size_t i{1}; i < lines.size(); ++i)
+                sum += u8_iedit_distance(lines[i - 1], lines[i], 3) != std::string_view::npos;
+            keep(sum);
+        });
+        add("batch_iedit_distance", [&] { batch_iedit_distance(lines, fuzzy_pattern, 3, distances); keep(distances); });
+    }
+
+private:
+
+    const Options& options_;
+    const char* corpus_;
+    const std::string& text_;
+    std::vector<Result>& results_;
+};
+
+
+void write_json_string(std::FILE* file, std::string_view v)
+{
+    std::fputc('"', file);
+    for (char c : v) {
+        if (c == '"' || c == '\\')
+            std::fputc('\\', file);
+        std::fputc(c, file);
+    }
+    std::fputc('"', file);
+}
+
+
+bool write_json(const char* path, const std::vector<Result>& results)
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (!file)
+        return false;
+
+    constexpr const char* simd_level_names[] = {"scalar", "sse2", "sse4.2", "avx2"};
+    std::fprintf(file, "{\n  \"version\": \"%s\",\n  \"simd_level\": \"%s\",\n  \"results\": [",
+        AUDAKI_U8STRING_VERSION, simd_level_names[static_cast<int>(simd_level())]);
+    for (std::size_t i{0}; i != results.size(); ++i) {
+        const auto& result = results[i];
+        std::fputs(i ? ",\n    {\"benchmark\": " : "\n    {\"benchmark\": ", file);
+        write_json_string(file, result.benchmark);
+        std::fputs(", \"corpus\": ", file);
+        write_json_string(file, result.corpus);
+        std::fprintf(file, ", \"size\": %zu, \"iterations\": %zu, \"ns_per_op\": %.3f, \"bytes_per_second\": %.1f, \"allocations_per_op\": %.3f}",
+            result.size, result.iterations, result.ns_per_op, result.bytes_per_second, result.allocations_per_op);
+    }
+    std::fputs("\n  ]\n}\n", file);
+
+    return std::fclose(file) == 0;
+}
+
+}
+
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int arg{1}; arg < argc; ++arg) {
+        std::string_view option{argv[arg]};
+        if (arg + 1 == argc) {
+            std::fprintf(stderr, "usage: %s [--filter TEXT] [--min-time MS] [--json FILE]\n", argv[0]);
+            return 2;
+        }
+
+        if (option == "--filter")
+            options.filter = argv[++arg];
+        else if (option == "--min-time")
+            options.min_time = std::chrono::milliseconds{std::strtoul(argv[++arg], nullptr, 10)};
+        else if (option == "--json")
+            options.json_path = argv[++arg];
+        else {
+            std::fprintf(stderr, "usage: %s [--filter TEXT] [--min-time MS] [--json FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+    for (const auto& corpus : corpora()) {
+        for (std::size_t size : {16, 256, 4096, 65536, 1 << 20}) {
+            std::string text = make_text(corpus, size);
+            Suite{options, corpus.name, text, results}.run_all();
+        }
+    }
+
+    if (options.json_path && !write_json(options.json_path, results)) {
+        std::fprintf(stderr, "%s: can't write %s\n", argv[0], options.json_path);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "audaki/u8string.h"
+
+#include <cstdio>
+#include <fstream>
+
+
+
+/**
+ * Case insensitive grep on the library, for comparisons with grep -i.
+ *
+ *     audaki-u8string-grep [-c] [-j] PATTERN FILE
+ *
+ * Prints the matching lines with their line numbers like grep -in, or with -c only their number. -j searches
+ * on all cores.
+ */
+int main(int argc, char** argv)
+{
+    bool is_count{false};
+    Execution execution{Execution::sequential};
+
+    int arg{1};
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        std::string_view option{argv[arg]};
+        if (option == "-c")
+            is_count = true;
+        else if (option == "-j")
+            execution = Execution::parallel;
+        else
+            break;
+    }
+
+    if (argc - arg != 2) {
+        std::fprintf(stderr, "usage: %s [-c] [-j] PATTERN FILE\n", argv[0]);
+        return 2;
+    }
+
+    const char* path = argv[arg + 1];
+    auto matches = icase_grep_file(path, Icase_pattern{argv[arg]}, execution);
+    if (!matches) {
+        std::fprintf(stderr, "%s: can't read %s\n", argv[0], path);
+        return 2;
+    }
+
+    if (is_count) {
+        std::printf("%zu\n", matches->size());
+        return matches->empty();
+    }
+
+    // The matches are in file order, so the lines are read front to back
+    std::ifstream file{path, std::ios::binary};
+    std::string line;
+    for (const auto& match : *matches) {
+        file.seekg(static_cast<std::streamoff>(match.line_begin));
+        std::getline(file, line);
+        // Written with fwrite as lines may contain NUL bytes
+        std::printf("%zu:", match.line_number);
+        std::fwrite(line.data(), 1, line.size(), stdout);
+        std::putchar('\n');
+    }
+
+    return matches->empty();
+}